@@ -1,30 +1,50 @@
 #include <iostream>
+#include <vector>
 #include "scene.h"
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << "[scene_description_file.txt] [xres] [yres]" << std::endl;
+    // Split the arguments into positional ones and "--option value" pairs
+    std::vector<std::string> positional;
+    ::rendering::LineMode line_mode = ::rendering::BRESENHAM;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--lines" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "bresenham") {
+                line_mode = ::rendering::BRESENHAM;
+            } else if (mode == "wu") {
+                line_mode = ::rendering::XIAOLIN_WU;
+            } else {
+                std::cerr << "Error: Line mode must be bresenham or wu" << std::endl;
+                return 1;
+            }
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.size() != 3) {
+        std::cerr << "Usage: " << argv[0] << "[scene_description_file.txt] [xres] [yres] [--lines bresenham|wu]" << std::endl;
         return 1;
     }
 
-    std::string scene_filename = argv[1];
-    
+    std::string scene_filename = positional[0];
+
     // Create and load the scene
     scene::SceneFile scene(scene_filename);
-    
+
     // Print scene information
     // std::cout << "Scene loaded successfully!" << std::endl;
     // std::cout << "\nCamera settings:" << std::endl;
     // scene.camera.serialize();
-    
+
     // std::cout << "\nLoaded " << scene.objects.size() << " object(s):" << std::endl;
     // for (const auto& obj : scene.objects) {
     //     std::cout << "  - " << obj.name << " (" << obj.points.cols() << " vertices)" << std::endl;
     // }
 
-    ::ppm_image::PPMImage<uint8_t> image = scene.render(std::stoi(argv[2]), std::stoi(argv[3]));
+    ::ppm_image::PPMImage<uint8_t> image = scene.render(std::stoi(positional[1]), std::stoi(positional[2]), line_mode);
     image.serialize();
-    
+
     return 0;
 }
-
@@ -8,10 +8,28 @@
 #include <array>
 #include <variant>
 #include <memory>
+#include <optional>
 #include <Eigen/Dense>
 
 namespace models{
 
+// Which faces are skipped before rasterization, set per object with a "cull back|front|none|silhouette" line in the scene file
+enum CullMode {
+    CULL_DEFAULT,       // back faces for the shaded modes, nothing for wireframes
+    CULL_BACK,
+    CULL_FRONT,
+    CULL_NONE,
+    CULL_SILHOUETTE     // wireframes only draw edges between a front and a back face, shaded modes treat it as CULL_BACK
+};
+
+inline std::optional<CullMode> parse_cull_mode(const std::string& name) {
+    if (name == "back") return CULL_BACK;
+    if (name == "front") return CULL_FRONT;
+    if (name == "none") return CULL_NONE;
+    if (name == "silhouette") return CULL_SILHOUETTE;
+    return std::nullopt;
+}
+
 // Object file class that stores the vertexes and faces, and support laoding from .obj file by calling load_from_obj_file()
 struct ObjModel {
 
@@ -19,13 +37,29 @@ struct ObjModel {
     using vertexList = std::vector<Eigen::Vector3d>;
     using FaceList = std::vector<Face>;
 
+    constexpr static std::size_t NO_FACE = -1;
+
+    // An edge between two vertexes, stored with the smaller vertex index first, together with the
+    // (up to two) faces sharing it. f1 is NO_FACE for edges on the boundary of an open mesh
+    struct Edge {
+        std::size_t v0;
+        std::size_t v1;
+        std::size_t f0;
+        std::size_t f1;
+    };
+    using EdgeList = std::vector<Edge>;
+
     void clear() {
         vertexes.clear();
         faces.clear();
+        edges.clear();
     }
 
     bool load_from_obj_file(const std::string& filename);
 
+    // Collect the edges of the faces, an edge shared by two faces is only kept once
+    static EdgeList compute_unique_edges(const FaceList& faces);
+
     Eigen::Matrix4Xd export_vertexes_matrix_homo(){
         const int num_cols = static_cast<int>(vertexes.size());
         Eigen::Matrix4Xd M(4, num_cols);
@@ -66,6 +100,7 @@ struct ObjModel {
     
     vertexList vertexes;
     FaceList faces;
+    EdgeList edges;     // unique edges of the faces, built once in load_from_obj_file()
     std::string filename;
 };
 
@@ -74,6 +109,7 @@ struct Model {
     std::shared_ptr<ObjModel> obj_file;
     std::string name;
     Eigen::Matrix4Xd points;
+    CullMode cull = CULL_DEFAULT;
 
     Model(const std::shared_ptr<ObjModel>& init_obj, std::string model_name = ""): 
     obj_file(init_obj), name(model_name) {
@@ -88,6 +124,11 @@ struct Model {
     const ObjModel::FaceList& faces() const {
         return obj_file->faces;
     }
+
+    // get the unique edges from the obj file
+    const ObjModel::EdgeList& edges() const {
+        return obj_file->edges;
+    }
 };
 
 
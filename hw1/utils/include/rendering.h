@@ -1,6 +1,7 @@
 #ifndef RENDERING_H
 #define RENDERING_H
 
+#include <cmath>
 #include <Eigen/Dense>
 #include "ppm_image.h"
 #include "models.h"
@@ -9,18 +10,59 @@ namespace rendering {
 
     constexpr bool ENABLE_ANTIALIASING = false;
 
+    // Line rasterizers that can be picked at runtime
+    enum LineMode {
+        BRESENHAM,      // integer Bresenham, antialiasing controlled by ENABLE_ANTIALIASING at compile time
+        XIAOLIN_WU      // Xiaolin Wu's antialiased lines with sub-pixel endpoints
+    };
+
+    // Facing of every face, a face is front facing when its vertexes are counter-clockwise in ndc space
+    std::vector<bool> compute_front_facing(const Eigen::Matrix3Xd& ndc_points, const models::ObjModel::FaceList& faces);
+
+    // Whether an edge survives culling, given the facing of the faces sharing it
+    inline bool edge_visible(const models::ObjModel::Edge& edge, const std::vector<bool>& front_facing, models::CullMode cull) {
+        bool front_0 = front_facing[edge.f0];
+        // A boundary edge only has f0 and is kept when f0 is: front facing under CULL_BACK and CULL_SILHOUETTE
+        // (an open border of a visible face is part of the outline), back facing under CULL_FRONT
+        bool front_1 = (edge.f1 == models::ObjModel::NO_FACE) ? false : front_facing[edge.f1];
+        bool back_1 = (edge.f1 == models::ObjModel::NO_FACE) ? false : !front_facing[edge.f1];
+
+        switch (cull) {
+            case models::CULL_BACK: return front_0 || front_1;
+            case models::CULL_FRONT: return !front_0 || back_1;
+            case models::CULL_SILHOUETTE: return front_0 != front_1;
+            default: return true;
+        }
+    }
+
     /* Draw the edges of the object on the image.
         @param image: the image to draw on, pass as a reference to incrementally draws on it
         @param ndc_points: the ndc points of the object
         @param faces: the surfaces of the object
         @param color: the color of the edges
+        @param line_mode: the line rasterizer to use
     */
     void draw_object_edges(::ppm_image::PPMImage<uint8_t>& image, const Eigen::Matrix3Xd& ndc_points, 
-        const models::ObjModel::FaceList& faces, ::ppm_image::Pixel<uint8_t> color = ::ppm_image::WHITE);
+        const models::ObjModel::FaceList& faces, ::ppm_image::Pixel<uint8_t> color = ::ppm_image::WHITE,
+        LineMode line_mode = BRESENHAM);
+
+    /* Draw a batch of edges on the image, every edge in the list is rasterized exactly once.
+        @param image: the image to draw on
+        @param ndc_points: the ndc points the edges index into
+        @param faces: the faces the edges refer to, used to decide their facing
+        @param edges: the edges to draw, e.g. the cached ObjModel::edges
+        @param cull: which edges to skip, see edge_visible()
+        @param color: the color of the edges
+        @param line_mode: the line rasterizer to use
+    */
+    void draw_edges(::ppm_image::PPMImage<uint8_t>& image, const Eigen::Matrix3Xd& ndc_points,
+        const models::ObjModel::FaceList& faces, const models::ObjModel::EdgeList& edges,
+        models::CullMode cull = models::CULL_NONE, ::ppm_image::Pixel<uint8_t> color = ::ppm_image::WHITE,
+        LineMode line_mode = BRESENHAM);
 
     // FillFunc should have the signature void(int x, int y, float alpha)
     template<typename FillFunc>
-    void bresenham_draw_line(int x0, int y0, int x1, int y1, FillFunc fill) {
+    void bresenham_draw_line(int x0, int y0, int x1, int y1, const FillFunc& fill) {
         bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
     
         if (steep) {
@@ -70,7 +112,66 @@ namespace rendering {
             }
         }
     }
-        
+
+    // Xiaolin Wu's line algorithm, pixel centers are at integer coordinates and the endpoints can be fractional.
+    // FillFunc should have the signature void(int x, int y, float alpha), alpha being the pixel coverage
+    template<typename FillFunc>
+    void wu_draw_line(double x0, double y0, double x1, double y1, const FillFunc& fill) {
+        auto fpart = [](double v) { return v - std::floor(v); };
+        auto rfpart = [&](double v) { return 1.0 - fpart(v); };
+
+        bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+        if (steep) {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+        if (x0 > x1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+
+        // Swap the axes back when filling, same as bresenham_draw_line()
+        auto plot = [&](int x, int y, double alpha) {
+            if (steep)
+                fill(y, x, static_cast<float>(alpha));
+            else
+                fill(x, y, static_cast<float>(alpha));
+        };
+
+        double dx = x1 - x0;
+        double dy = y1 - y0;
+        double gradient = (dx == 0.0) ? 1.0 : dy / dx;
+
+        // First endpoint
+        double x_end = std::round(x0);
+        double y_end = y0 + gradient * (x_end - x0);
+        double x_gap = rfpart(x0 + 0.5);
+        int x_start = static_cast<int>(x_end);
+        int y_start = static_cast<int>(std::floor(y_end));
+        plot(x_start, y_start, rfpart(y_end) * x_gap);
+        plot(x_start, y_start + 1, fpart(y_end) * x_gap);
+        double inter_y = y_end + gradient;
+
+        // Second endpoint
+        x_end = std::round(x1);
+        y_end = y1 + gradient * (x_end - x1);
+        x_gap = fpart(x1 + 0.5);
+        int x_stop = static_cast<int>(x_end);
+        int y_stop = static_cast<int>(std::floor(y_end));
+        if (x_stop != x_start) {
+            plot(x_stop, y_stop, rfpart(y_end) * x_gap);
+            plot(x_stop, y_stop + 1, fpart(y_end) * x_gap);
+        }
+
+        // Span between the endpoints, two pixels per column weighted by the distance to the ideal line
+        for (int x = x_start + 1; x < x_stop; x++) {
+            int y = static_cast<int>(std::floor(inter_y));
+            plot(x, y, rfpart(inter_y));
+            plot(x, y + 1, fpart(inter_y));
+            inter_y += gradient;
+        }
+    }
+
     // A test function to draw the only the dots of vertexes of the object
     void draw_object_dots(::ppm_image::PPMImage<uint8_t>& image, const Eigen::Matrix3Xd& ndc_points);
 
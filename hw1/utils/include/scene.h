@@ -174,8 +174,10 @@ public:
                 // std::cout << "New section: " << current_label << std::endl;
                 current_transform = Eigen::Matrix4d::Identity();
             } else if (state == States::GETTING_TRANSFORM) {
-                Eigen::Matrix4d new_T = parse_transformation_line(iss);
-                current_transform = new_T * current_transform; 
+                if (!try_parse_cull_line(line)) {
+                    Eigen::Matrix4d new_T = parse_transformation_line(iss);
+                    current_transform = new_T * current_transform; 
+                }
             } else if (state == States::ONE_SECTION_END) {
                 do_transform();
             }
@@ -195,14 +197,14 @@ public:
     // }
 
     // Rendering pipeline
-    ::ppm_image::PPMImage<uint8_t> render(int width, int height) const {
+    ::ppm_image::PPMImage<uint8_t> render(int width, int height, ::rendering::LineMode line_mode = ::rendering::BRESENHAM) const {
         ::ppm_image::PPMImage<uint8_t> result(height, width, ::ppm_image::BLACK);
         Eigen::Matrix4d T_ndc_pt = camera.get_perspective_projection_matrix() 
                             * camera.get_transformation().inverse();
                             
         for (const auto& object : objects) {
             Eigen::Matrix3Xd ndc_points_3d = ::transformation::points_homo_to_points_3d(T_ndc_pt * object.points);
-            ::rendering::draw_object_edges(result, ndc_points_3d, object.faces());
+            ::rendering::draw_edges(result, ndc_points_3d, object.faces(), object.edges(), object.cull, ::ppm_image::WHITE, line_mode);
         }
         
         return result;
@@ -217,6 +219,7 @@ private:
     std::unordered_map<std::string, std::pair<std::shared_ptr<models::ObjModel>, int>> object_files;
     std::string current_label;
     Eigen::Matrix4d current_transform;
+    models::CullMode current_cull = models::CULL_DEFAULT;
 
     void state_transition(std::string& line) {
         if (state == States::CAMERA) {
@@ -250,12 +253,31 @@ private:
         std::string new_label = current_label+"_copy"+std::to_string(count);
         models::Model new_object(it->second.first, new_label);
         new_object.points = current_transform * new_object.points;
+        new_object.cull = current_cull;
         objects.emplace_back(std::move(new_object));
         
         // std::cout << "new copy: " << new_label << " added" << std::endl;
         count++;
         current_transform = Eigen::Matrix4d::Identity();
         current_label = "NONE";
+        current_cull = models::CULL_DEFAULT;
+    }
+
+    // Parse a "cull back|front|none|silhouette" line of an object section, returns false for other lines
+    bool try_parse_cull_line(const std::string& line) {
+        std::istringstream iss(line);
+        std::string field_name, mode_name;
+        iss >> field_name;
+        if (field_name != "cull")
+            return false;
+
+        iss >> mode_name;
+        std::optional<models::CullMode> mode = models::parse_cull_mode(mode_name);
+        if (mode.has_value())
+            current_cull = mode.value();
+        else
+            std::cerr << "Error: Unknown cull mode \"" << mode_name << "\"" << std::endl;
+        return true;
     }
 };
 
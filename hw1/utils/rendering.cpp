@@ -8,28 +8,52 @@
 namespace rendering {
 
 void draw_object_edges(::ppm_image::PPMImage<uint8_t>& image, const Eigen::Matrix3Xd& ndc_points, 
-                       const models::ObjModel::FaceList& faces, ::ppm_image::Pixel<uint8_t> color) {
-    // Draw vertices for now
-    for (const auto& face: faces) {
-
-        for (int i=0; i<3; i++) {
-            int start_point_idx = face[i];
-            int end_point_idx = face[(i+1)%3];
-            
-            int x0 = static_cast<int>((ndc_points(0, start_point_idx) + 1.0) / 2.0 * image.w());
-            int y0 = static_cast<int>((1.0 - ndc_points(1, start_point_idx)) / 2.0 * image.h());
-            int x1 = static_cast<int>((ndc_points(0, end_point_idx) + 1.0) / 2.0 * image.w());
-            int y1 = static_cast<int>((1.0 - ndc_points(1, end_point_idx)) / 2.0 * image.h());
-
-            // std::cout << ndc_points(0, start_point_idx) << "; " << ndc_points(0, end_point_idx) << std::endl;
-
-            rendering::bresenham_draw_line(x0, y0, x1, y1, [&](int x, int y, float alpha){
-                if (x >= 0 && x < static_cast<int>(image.w()) && y >= 0 && y < static_cast<int>(image.h())) {
-                    image[y][x] = image[y][x] * (1 - alpha) + color * alpha;
-                }
-                // std::cout << "filling " << y << " " << x << std::endl;
-            });
+                       const models::ObjModel::FaceList& faces, ::ppm_image::Pixel<uint8_t> color, LineMode line_mode) {
+    draw_edges(image, ndc_points, faces, models::ObjModel::compute_unique_edges(faces), models::CULL_NONE, color, line_mode);
+}
+
+std::vector<bool> compute_front_facing(const Eigen::Matrix3Xd& ndc_points, const models::ObjModel::FaceList& faces) {
+    std::vector<bool> front_facing(faces.size());
+    for (std::size_t f = 0; f < faces.size(); f++) {
+        Eigen::Vector3d ndc_a = ndc_points.col(faces[f][0]);
+        Eigen::Vector3d ndc_b = ndc_points.col(faces[f][1]);
+        Eigen::Vector3d ndc_c = ndc_points.col(faces[f][2]);
+        front_facing[f] = (ndc_b - ndc_a).cross(ndc_c - ndc_a).z() > 0;
+    }
+    return front_facing;
+}
+
+void draw_edges(::ppm_image::PPMImage<uint8_t>& image, const Eigen::Matrix3Xd& ndc_points,
+                const models::ObjModel::FaceList& faces, const models::ObjModel::EdgeList& edges,
+                models::CullMode cull, ::ppm_image::Pixel<uint8_t> color, LineMode line_mode) {
+    // Decide the facing once per face, culled edges are dropped before any rasterization
+    const bool culling = cull != models::CULL_NONE && cull != models::CULL_DEFAULT;
+    std::vector<bool> front_facing;
+    if (culling)
+        front_facing = compute_front_facing(ndc_points, faces);
+
+    auto fill = [&](int x, int y, float alpha){
+        if (x >= 0 && x < static_cast<int>(image.w()) && y >= 0 && y < static_cast<int>(image.h())) {
+            image[y][x] = image[y][x] * (1 - alpha) + color * alpha;
+        }
+    };
+
+    for (const auto& edge : edges) {
+        if (culling && !edge_visible(edge, front_facing, cull))
+            continue;
+
+        // Sub-pixel screen coordinates, y is flipped so that the image is upright
+        double x0 = (ndc_points(0, edge.v0) + 1.0) / 2.0 * image.w();
+        double y0 = (1.0 - ndc_points(1, edge.v0)) / 2.0 * image.h();
+        double x1 = (ndc_points(0, edge.v1) + 1.0) / 2.0 * image.w();
+        double y1 = (1.0 - ndc_points(1, edge.v1)) / 2.0 * image.h();
 
+        if (line_mode == XIAOLIN_WU) {
+            // Shift by half a pixel so that pixel centers sit on integer coordinates as wu_draw_line() expects
+            rendering::wu_draw_line(x0 - 0.5, y0 - 0.5, x1 - 0.5, y1 - 0.5, fill);
+        } else {
+            rendering::bresenham_draw_line(static_cast<int>(x0), static_cast<int>(y0),
+                                           static_cast<int>(x1), static_cast<int>(y1), fill);
         }
     }
 }
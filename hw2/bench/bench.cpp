@@ -0,0 +1,275 @@
+// Microbenchmarks of the rendering hot paths, run with ./bench (any Google Benchmark flag works, such as
+// --benchmark_filter=lighting or --benchmark_repetitions=5). Throughput is reported as rates next to the times:
+// triangles/s and fragments/s for rasterization, items/s for per call work and bytes/s for file and image IO.
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <Eigen/Dense>
+#include "scene.h"
+#include "transformation.h"
+#include "rendering.h"
+#include "shader.h"
+#include "profiler.h"
+#include "incremental.h"
+
+namespace {
+
+const std::string DATA_DIR = HW2_DATA_DIR;
+
+// Scenes are parsed once per process, the benchmarks only time the rendering calls
+const scene::SceneFile& load_scene(const std::string& name) {
+    static std::map<std::string, std::unique_ptr<scene::SceneFile>> scenes;
+    auto& entry = scenes[name];
+    if (!entry)
+        entry = std::make_unique<scene::SceneFile>(DATA_DIR + "/scene_" + name + ".txt");
+    return *entry;
+}
+
+// Random lights around the origin, deterministic so every run lights the same points
+std::vector<scene::PointLight> make_lights(int count) {
+    std::mt19937 rng(171);
+    std::uniform_real_distribution<double> position(-4.0, 4.0);
+    std::uniform_real_distribution<float> color(0.0f, 1.0f);
+    std::vector<scene::PointLight> lights(count);
+    for (auto& light : lights) {
+        light.position = Eigen::Vector3d(position(rng), position(rng), position(rng) + 5.0);
+        light.color = ppm_image::Pixel<float>(color(rng), color(rng), color(rng));
+        light.k = 0.05;
+        light.update_influence_radius();
+    }
+    return lights;
+}
+
+
+void BM_compute_alpha_beta_gamma(benchmark::State& state) {
+    const double xa = 3.0, ya = 5.0, xb = 250.0, yb = 40.0, xc = 120.0, yc = 230.0;
+    std::int64_t points = 0;
+    for (auto _ : state) {
+        for (int y = 0; y < 256; y += 4) {
+            for (int x = 0; x < 256; x += 4) {
+                auto abc = rendering::compute_alpha_beta_gamma(xa, ya, xb, yb, xc, yc, x, y);
+                benchmark::DoNotOptimize(abc);
+            }
+        }
+        points += 64 * 64;
+    }
+    state.SetItemsProcessed(points);
+}
+BENCHMARK(BM_compute_alpha_beta_gamma);
+
+
+// Phong shaded render_object() of every object of a scene, args: resolution
+void render_scene_objects(benchmark::State& state, const std::string& scene_name) {
+    const scene::SceneFile& scene = load_scene(scene_name);
+    const int resolution = static_cast<int>(state.range(0));
+    ppm_image::PPMImage<float> image(resolution, resolution, 1);
+    Eigen::MatrixXd z_buffer(resolution, resolution);
+    std::vector<scene::PointLight> lights = scene.lights;
+
+    auto render = [&]() {
+        z_buffer.setOnes();
+        for (const auto& object : scene.objects) {
+            shader::Phong phong(const_cast<models::Model&>(object), lights, scene.camera.position);
+            rendering::render_object(image, object, scene.camera, phong, z_buffer);
+        }
+    };
+
+    // One profiled pass outside the timing loop gives the per frame triangle and fragment counts
+    profiler::Stats stats;
+    {
+        profiler::Session session(&stats);
+        render();
+    }
+    const double triangles = stats.counts[profiler::TRIANGLES_CULLED] + stats.counts[profiler::TRIANGLES_RASTERIZED];
+    const double fragments = stats.counts[profiler::FRAGMENTS_SHADED];
+
+    for (auto _ : state) {
+        render();
+        benchmark::ClobberMemory();
+    }
+    state.counters["triangles/s"] = benchmark::Counter(triangles * state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["fragments/s"] = benchmark::Counter(fragments * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void BM_render_object_sphere(benchmark::State& state) {
+    render_scene_objects(state, "sphere");
+}
+BENCHMARK(BM_render_object_sphere)->Arg(200)->Arg(400)->Arg(800)->Unit(benchmark::kMillisecond);
+
+void BM_render_object_kitten(benchmark::State& state) {
+    render_scene_objects(state, "kitten");
+}
+BENCHMARK(BM_render_object_kitten)->Arg(200)->Arg(400)->Arg(800)->Unit(benchmark::kMillisecond);
+
+
+// lighting() at a fixed point, args: number of lights, packed (1) or exact (0)
+void BM_lighting(benchmark::State& state) {
+    const scene::SceneFile& scene = load_scene("sphere");
+    const models::Model& model = scene.objects.front();
+    std::vector<scene::PointLight> lights = make_lights(static_cast<int>(state.range(0)));
+    rendering::PackedLights packed(lights);
+    const bool use_packed = state.range(1) != 0;
+    const Eigen::Vector3d P(0.1, 0.2, 0.9);
+    const Eigen::Vector3d normal = P.normalized();
+
+    for (auto _ : state) {
+        ppm_image::Pixel<float> color = use_packed
+            ? rendering::lighting(P, normal, model, packed, scene.camera.position, nullptr)
+            : rendering::lighting(P, normal, model, lights, scene.camera.position, nullptr);
+        benchmark::DoNotOptimize(color);
+    }
+    // One item is one light evaluated at one point
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_lighting)->ArgsProduct({{1, 2, 4, 8, 16, 32, 64}, {0, 1}});
+
+
+// Lines in every octant across a 512x512 canvas, args: line length
+void BM_bresenham_draw_line(benchmark::State& state) {
+    const int length = static_cast<int>(state.range(0));
+    std::vector<std::uint8_t> canvas(512 * 512);
+    std::int64_t pixels = 0;
+    auto fill = [&](int x, int y, float) {
+        canvas[(y & 511) * 512 + (x & 511)] = 1;
+        pixels++;
+    };
+
+    for (auto _ : state) {
+        for (int i = 0; i < 16; i++) {
+            double angle = i * M_PI / 8.0;
+            int x1 = 256 + static_cast<int>(length * std::cos(angle));
+            int y1 = 256 + static_cast<int>(length * std::sin(angle));
+            rendering::bresenham_draw_line(256, 256, x1, y1, fill);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(pixels);
+}
+BENCHMARK(BM_bresenham_draw_line)->Arg(16)->Arg(128)->Arg(250);
+
+
+// Parsing an obj file from disk, args: none, bytes/s is relative to the file size
+void obj_load(benchmark::State& state, const std::string& filename) {
+    const std::string path = DATA_DIR + "/" + filename;
+    const auto file_size = static_cast<std::int64_t>(std::filesystem::file_size(path));
+    for (auto _ : state) {
+        models::ObjModel obj;
+        bool ok = obj.load_from_obj_file(path);
+        benchmark::DoNotOptimize(ok);
+    }
+    state.SetBytesProcessed(state.iterations() * file_size);
+}
+
+void BM_load_from_obj_file_sphere(benchmark::State& state) {
+    obj_load(state, "sphere.obj");
+}
+BENCHMARK(BM_load_from_obj_file_sphere)->Unit(benchmark::kMillisecond);
+
+void BM_load_from_obj_file_kitten(benchmark::State& state) {
+    obj_load(state, "kitten.obj");
+}
+BENCHMARK(BM_load_from_obj_file_kitten)->Unit(benchmark::kMillisecond);
+
+
+// PPMImage::serialize() of a float image into memory, args: resolution
+void BM_serialize(benchmark::State& state) {
+    const int resolution = static_cast<int>(state.range(0));
+    ppm_image::PPMImage<float> image(resolution, resolution, 1);
+    for (int y = 0; y < resolution; y++)
+        for (int x = 0; x < resolution; x++)
+            image[y][x] = ppm_image::Pixel<float>(x / float(resolution), y / float(resolution), 0.5f);
+
+    std::int64_t bytes = 0;
+    for (auto _ : state) {
+        std::ostringstream os;
+        image.serialize(os);
+        bytes += static_cast<std::int64_t>(os.tellp());
+    }
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_serialize)->Arg(200)->Arg(800)->Unit(benchmark::kMillisecond);
+
+
+// Move the small cube of the shadows scene and redraw, args: resolution, incremental (0 renders the whole frame)
+void BM_incremental_update(benchmark::State& state) {
+    scene::SceneFile scene(DATA_DIR + "/scene_shadows.txt");
+    const int resolution = static_cast<int>(state.range(0));
+    const bool incremental = state.range(1) != 0;
+    scene::IncrementalRenderer renderer(scene, resolution, resolution, scene::SceneFile::PHONG);
+    scene::FrameBuffers buffers(resolution, resolution, 1);
+    renderer.update();
+
+    Eigen::Matrix4d& transform = scene.objects[2].transform;
+    const double x = transform(0, 3);
+    int step = 0;
+    for (auto _ : state) {
+        transform(0, 3) = x + 0.05 * (step++ % 16);
+        if (incremental)
+            benchmark::DoNotOptimize(renderer.update());
+        else
+            scene.render_into(buffers, scene::SceneFile::PHONG, rendering::RenderOptions(), scene.camera);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_incremental_update)->ArgsProduct({{400, 800}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+
+// Full frame of a grid of cubes spread far beyond the view, args: instances. With the instance hierarchy the time
+// follows the few cubes in the frustum rather than the instance count.
+void BM_many_instances(benchmark::State& state) {
+    scene::SceneFile scene(DATA_DIR + "/scene_cube1.txt");
+    const int instances = static_cast<int>(state.range(0));
+    const models::Model cube = scene.objects.front();
+    scene.objects.clear();
+    const int side = static_cast<int>(std::ceil(std::cbrt(instances)));
+    for (int i = 0; i < instances; i++) {
+        models::Model copy = cube;
+        copy.transform = transformation::matrix_from_translation_vector(
+            3.0 * (i % side - side / 2), 3.0 * (i / side % side - side / 2), -3.0 * (i / (side * side))) * cube.transform;
+        scene.objects.push_back(copy);
+    }
+    scene::FrameBuffers buffers(400, 400);
+    scene.render_into(buffers, scene::SceneFile::GOURAUD, rendering::RenderOptions(), scene.camera);
+
+    for (auto _ : state)
+        scene.render_into(buffers, scene::SceneFile::GOURAUD, rendering::RenderOptions(), scene.camera);
+    state.SetItemsProcessed(state.iterations() * instances);
+}
+BENCHMARK(BM_many_instances)->Arg(1000)->Arg(8000)->Unit(benchmark::kMillisecond);
+
+
+// Ray traced frame, args: resolution. Rays/s counts the primary, shadow and reflection rays.
+void raytrace_scene(benchmark::State& state, const std::string& scene_name) {
+    const scene::SceneFile& scene = load_scene(scene_name);
+    const int resolution = static_cast<int>(state.range(0));
+    scene::FrameBuffers buffers(resolution, resolution);
+
+    profiler::Stats stats;
+    {
+        profiler::Session session(&stats);
+        scene.render_into(buffers, scene::SceneFile::RAYTRACE, rendering::RenderOptions(), scene.camera);
+    }
+    for (auto _ : state)
+        scene.render_into(buffers, scene::SceneFile::RAYTRACE, rendering::RenderOptions(), scene.camera);
+    state.counters["rays/s"] = benchmark::Counter(static_cast<double>(stats.counts[profiler::RAYS]) * state.iterations(),
+                                                  benchmark::Counter::kIsRate);
+}
+
+void BM_raytrace_kitten(benchmark::State& state) {
+    raytrace_scene(state, "kitten");
+}
+BENCHMARK(BM_raytrace_kitten)->Arg(200)->Arg(400)->Unit(benchmark::kMillisecond);
+
+void BM_raytrace_shadows(benchmark::State& state) {
+    raytrace_scene(state, "shadows");
+}
+BENCHMARK(BM_raytrace_shadows)->Arg(200)->Arg(400)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -1,41 +1,160 @@
 #include <iostream>
+#include <vector>
+#include <thread>
+#include <algorithm>
 #include "scene.h"
+#include "profiler.h"
+#include "animation.h"
 
 int main(int argc, char* argv[]) {
-    if (argc != 4 && argc != 5) {
-        std::cerr << "Usage: " << argv[0] << " [scene_description_file.txt] [xres] [yres] [optional mode]" << std::endl;
+    // Split the arguments into positional ones and "--option value" pairs
+    std::vector<std::string> positional;
+    rendering::RenderOptions options;
+    bool print_stats = false;
+    // Batch mode: render frames along a camera path into numbered files instead of one image to stdout
+    std::string camera_path_file;
+    int frames = 0;
+    std::string output_prefix = "frame";
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int frames_in_flight = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            options.samples = std::stoi(argv[++i]);
+            if (rendering::sample_pattern(options.samples).empty()) {
+                std::cerr << "Error: Samples must be 1, 2, 4 or 8" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--lines" && i + 1 < argc) {
+            std::string line_mode = argv[++i];
+            if (line_mode == "bresenham") {
+                options.line_mode = rendering::BRESENHAM;
+            } else if (line_mode == "wu") {
+                options.line_mode = rendering::XIAOLIN_WU;
+            } else {
+                std::cerr << "Error: Line mode must be bresenham or wu" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--packed-lights") {
+            options.packed_lights = true;
+        } else if (arg == "--camera-path" && i + 1 < argc) {
+            camera_path_file = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::stoi(argv[++i]);
+            if (frames <= 0) {
+                std::cerr << "Error: Frames must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+            if (threads <= 0) {
+                std::cerr << "Error: Threads must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            frames_in_flight = std::stoi(argv[++i]);
+            if (frames_in_flight <= 0) {
+                std::cerr << "Error: Frames in flight must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_prefix = argv[++i];
+        } else if (arg == "--stats") {
+            print_stats = true;
+        } else if (arg == "--shadows") {
+            options.shadows = true;
+        } else if (arg == "--shadow-resolution" && i + 1 < argc) {
+            options.shadow_resolution = std::stoi(argv[++i]);
+            if (options.shadow_resolution <= 0) {
+                std::cerr << "Error: Shadow resolution must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--bounces" && i + 1 < argc) {
+            options.reflection_depth = std::stoi(argv[++i]);
+            if (options.reflection_depth < 0) {
+                std::cerr << "Error: Bounces must not be negative" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--specular" && i + 1 < argc) {
+            std::string specular_mode = argv[++i];
+            if (specular_mode == "exact") {
+                options.specular_mode = rendering::SPECULAR_EXACT;
+            } else if (specular_mode == "table") {
+                options.specular_mode = rendering::SPECULAR_TABLE;
+            } else {
+                std::cerr << "Error: Specular mode must be exact or table" << std::endl;
+                return 1;
+            }
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.size() != 3 && positional.size() != 4) {
+        std::cerr << "Usage: " << argv[0] << " [scene_description_file.txt] [xres] [yres] [optional mode] [--samples 1|2|4|8] [--lines bresenham|wu] [--packed-lights] [--specular exact|table] [--shadows] [--shadow-resolution N] [--bounces N] [--stats] [--camera-path file --frames N --output prefix [--threads N] [--frames-in-flight N]]" << std::endl;
         return 1;
     }
 
-    std::string scene_filename = argv[1];
-    
+    std::string scene_filename = positional[0];
+
     // Create and load the scene
     scene::SceneFile scene(scene_filename);
 
     // Parse optional mode argument
     scene::SceneFile::RenderMode mode = scene::SceneFile::RenderMode::GOURAUD;
-    if (argc == 5) {
-        int mode_int = std::stoi(argv[4]);
-        if (mode_int < 0 || mode_int > 2) {
-            std::cerr << "Error: Mode must be 0 (GOURAUD), 1 (PHONG), or 2 (EDGES)" << std::endl;
+    if (positional.size() == 4) {
+        int mode_int = std::stoi(positional[3]);
+        if (mode_int < 0 || mode_int > 3) {
+            std::cerr << "Error: Mode must be 0 (GOURAUD), 1 (PHONG), 2 (EDGES) or 3 (RAYTRACE)" << std::endl;
             return 1;
         }
         mode = static_cast<scene::SceneFile::RenderMode>(mode_int);
     }
-    
+
     // Print scene information
     // std::cout << "Scene loaded successfully!" << std::endl;
     // std::cout << "\nCamera settings:" << std::endl;
     // scene.camera.serialize();
-    
+
     // std::cout << "\nLoaded " << scene.objects.size() << " object(s):" << std::endl;
     // for (const auto& obj : scene.objects) {
     //     std::cout << "  - " << obj.name << " (" << obj.points.cols() << " vertices)" << std::endl;
     // }
 
-    ::ppm_image::PPMImage<float> image = scene.render(std::stoi(argv[2]), std::stoi(argv[3]), mode);
-    image.serialize();
-    
+    if (!camera_path_file.empty()) {
+        std::optional<animation::CameraPath> path = animation::CameraPath::load(camera_path_file, scene.camera);
+        if (!path)
+            return 1;
+        if (frames == 0)
+            frames = static_cast<int>(path->keys.size());
+        if (frames_in_flight == 0)
+            frames_in_flight = threads + 1;
+
+        profiler::Stats stats;
+        bool ok;
+        {
+            profiler::Session session(print_stats ? &stats : nullptr);
+            ok = animation::render_sequence(scene, *path, frames, std::stoi(positional[1]), std::stoi(positional[2]),
+                                            mode, options, output_prefix, threads, frames_in_flight);
+        }
+        if (print_stats)
+            stats.write_json(std::cerr);
+        return ok ? 0 : 1;
+    }
+
+    // A single image gets all threads for its tiles, batch mode above spreads them over frames instead
+    options.threads = threads;
+
+    // Record the pipeline stages while rendering, the stats go to stderr as the image goes to stdout
+    profiler::Stats stats;
+    {
+        profiler::Session session(print_stats ? &stats : nullptr);
+        ::ppm_image::PPMImage<float> image = scene.render(std::stoi(positional[1]), std::stoi(positional[2]), mode, options);
+        profiler::ScopedTimer timer(profiler::SERIALIZE);
+        image.serialize();
+    }
+    if (print_stats)
+        stats.write_json(std::cerr);
+
     return 0;
 }
-
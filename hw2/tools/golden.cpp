@@ -0,0 +1,308 @@
+// Golden image regression check of shaded_renderer.
+//
+// Renders every scene_*.txt of a data directory in the GOURAUD, PHONG and EDGES modes, each in its own process, and
+// compares the result against the reference scene_<name>_<Gouraud|Phong>.png next to it when there is one.
+// Wall time and peak RSS of every render are written to a CSV so performance changes show up with the results.
+//
+// Usage: golden_compare [shaded_renderer] [data_dir] [output.csv] [extra renderer flags...]
+// Exits with 1 when any image with a reference fails the comparison.
+#include <png.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// 8 bit RGB image, row 0 at the top like both PNG and the serialized PPM
+struct RGBImage {
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> data;
+};
+
+// Perceptual tolerance: both images are blurred with a 3x3 box filter, so one pixel shifts along edges are forgiven,
+// then a pixel mismatches when its luma differs by more than LUMA_TOLERANCE out of 255.
+// An image passes when at most MAX_MISMATCH_FRACTION of its pixels mismatch.
+constexpr double LUMA_TOLERANCE = 12.0;
+constexpr double MAX_MISMATCH_FRACTION = 0.01;
+
+const char* MODE_NAMES[] = {"Gouraud", "Phong", "Edges"};
+
+std::optional<RGBImage> read_png(const std::string& path) {
+    png_image png;
+    std::fill(reinterpret_cast<char*>(&png), reinterpret_cast<char*>(&png) + sizeof(png), 0);
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&png, path.c_str())) {
+        std::cerr << "Error: Could not read " << path << ": " << png.message << std::endl;
+        return std::nullopt;
+    }
+    png.format = PNG_FORMAT_RGB;
+
+    RGBImage image;
+    image.width = static_cast<int>(png.width);
+    image.height = static_cast<int>(png.height);
+    image.data.resize(PNG_IMAGE_SIZE(png));
+    if (!png_image_finish_read(&png, nullptr, image.data.data(), 0, nullptr)) {
+        std::cerr << "Error: Could not decode " << path << ": " << png.message << std::endl;
+        png_image_free(&png);
+        return std::nullopt;
+    }
+    return image;
+}
+
+bool write_png(const std::string& path, const RGBImage& image) {
+    png_image png;
+    std::fill(reinterpret_cast<char*>(&png), reinterpret_cast<char*>(&png) + sizeof(png), 0);
+    png.version = PNG_IMAGE_VERSION;
+    png.width = image.width;
+    png.height = image.height;
+    png.format = PNG_FORMAT_RGB;
+    return png_image_write_to_file(&png, path.c_str(), 0, image.data.data(), 0, nullptr) != 0;
+}
+
+// Parse the plain P3 output of PPMImage::serialize()
+std::optional<RGBImage> parse_ppm(const std::string& text) {
+    std::istringstream is(text);
+    std::string magic;
+    int max_value;
+    RGBImage image;
+    if (!(is >> magic >> image.width >> image.height >> max_value) || magic != "P3" || max_value <= 0)
+        return std::nullopt;
+
+    image.data.resize(static_cast<std::size_t>(image.width) * image.height * 3);
+    for (auto& value : image.data) {
+        int v;
+        if (!(is >> v))
+            return std::nullopt;
+        value = static_cast<std::uint8_t>(std::clamp(v * 255 / max_value, 0, 255));
+    }
+    return image;
+}
+
+// Luma of the 3x3 box filtered image
+std::vector<double> blurred_luma(const RGBImage& image) {
+    std::vector<double> luma(static_cast<std::size_t>(image.width) * image.height);
+    for (std::size_t i = 0; i < luma.size(); i++) {
+        const std::uint8_t* p = &image.data[i * 3];
+        luma[i] = 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+    }
+
+    std::vector<double> blurred(luma.size());
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            double sum = 0.0;
+            int count = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int sx = x + dx, sy = y + dy;
+                    if (sx < 0 || sy < 0 || sx >= image.width || sy >= image.height)
+                        continue;
+                    sum += luma[static_cast<std::size_t>(sy) * image.width + sx];
+                    count++;
+                }
+            }
+            blurred[static_cast<std::size_t>(y) * image.width + x] = sum / count;
+        }
+    }
+    return blurred;
+}
+
+struct Comparison {
+    double mismatch_fraction;
+    double psnr;
+};
+
+Comparison compare(const RGBImage& result, const RGBImage& reference) {
+    std::vector<double> a = blurred_luma(result);
+    std::vector<double> b = blurred_luma(reference);
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (std::abs(a[i] - b[i]) > LUMA_TOLERANCE)
+            mismatches++;
+    }
+
+    double squared_error = 0.0;
+    for (std::size_t i = 0; i < result.data.size(); i++) {
+        double d = static_cast<double>(result.data[i]) - reference.data[i];
+        squared_error += d * d;
+    }
+    double mse = squared_error / result.data.size();
+    double psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+    return {static_cast<double>(mismatches) / a.size(), psnr};
+}
+
+struct RunResult {
+    bool ok = false;
+    std::string output;
+    double wall_ms = 0.0;
+    long peak_rss_kb = 0;
+};
+
+// Run the renderer in a child process, collect its stdout, wall time and peak resident set size
+RunResult run_renderer(const std::vector<std::string>& args) {
+    RunResult result;
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        std::cerr << "Error: Could not create a pipe" << std::endl;
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Error: Could not fork" << std::endl;
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return result;
+    }
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        std::vector<char*> argv;
+        for (const auto& arg : args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = read(pipe_fds[0], buffer, sizeof(buffer))) > 0)
+        result.output.append(buffer, n);
+    close(pipe_fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return result;
+}
+
+// Mesh files listed in the "objects:" section of a scene, used to skip scenes whose meshes are not shipped
+bool meshes_available(const std::filesystem::path& scene_file) {
+    std::ifstream file(scene_file);
+    std::string line;
+    bool in_objects = false;
+    while (std::getline(file, line)) {
+        if (line == "objects:") {
+            in_objects = true;
+            continue;
+        }
+        if (!in_objects)
+            continue;
+        if (line.empty())
+            break;
+        std::istringstream iss(line);
+        std::string label, obj_file;
+        iss >> label >> obj_file;
+        if (!std::filesystem::exists(scene_file.parent_path() / obj_file))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " [shaded_renderer] [data_dir] [output.csv] [extra renderer flags...]" << std::endl;
+        return 1;
+    }
+    const std::string renderer = argv[1];
+    const std::filesystem::path data_dir = argv[2];
+    const std::filesystem::path csv_path = argv[3];
+    std::vector<std::string> extra_flags(argv + 4, argv + argc);
+    // Failed renders are kept as <csv name>_<scene>_<mode>.png next to the CSV for inspection
+    const std::filesystem::path failure_dir = csv_path.parent_path();
+
+    std::vector<std::filesystem::path> scenes;
+    for (const auto& entry : std::filesystem::directory_iterator(data_dir)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("scene_", 0) == 0 && entry.path().extension() == ".txt")
+            scenes.push_back(entry.path());
+    }
+    std::sort(scenes.begin(), scenes.end());
+
+    std::ofstream csv(csv_path);
+    if (!csv.is_open()) {
+        std::cerr << "Error: Could not open " << csv_path << std::endl;
+        return 1;
+    }
+    csv << "scene,mode,width,height,wall_ms,peak_rss_kb,status,mismatch_fraction,psnr_db\n";
+
+    int failures = 0;
+    for (const auto& scene_file : scenes) {
+        const std::string scene = scene_file.stem().string().substr(std::string("scene_").size());
+        if (!meshes_available(scene_file)) {
+            std::cout << "SKIP " << scene << " (mesh files missing)" << std::endl;
+            csv << scene << ",,,,,,skipped,,\n";
+            continue;
+        }
+
+        for (int mode = 0; mode < 3; mode++) {
+            const std::filesystem::path reference_file = data_dir / ("scene_" + scene + "_" + MODE_NAMES[mode] + ".png");
+            std::optional<RGBImage> reference;
+            if (std::filesystem::exists(reference_file))
+                reference = read_png(reference_file.string());
+            const int width = reference ? reference->width : 800;
+            const int height = reference ? reference->height : 800;
+
+            std::vector<std::string> args = {renderer, scene_file.string(), std::to_string(width),
+                                             std::to_string(height), std::to_string(mode)};
+            args.insert(args.end(), extra_flags.begin(), extra_flags.end());
+            RunResult run = run_renderer(args);
+            std::optional<RGBImage> result = run.ok ? parse_ppm(run.output) : std::nullopt;
+
+            std::string status;
+            std::string mismatch_column, psnr_column;
+            if (!result) {
+                status = "error";
+                failures++;
+            } else if (!reference) {
+                status = "no_reference";
+            } else if (result->width != reference->width || result->height != reference->height) {
+                status = "size_mismatch";
+                failures++;
+            } else {
+                Comparison comparison = compare(*result, *reference);
+                mismatch_column = std::to_string(comparison.mismatch_fraction);
+                psnr_column = std::to_string(comparison.psnr);
+                if (comparison.mismatch_fraction <= MAX_MISMATCH_FRACTION) {
+                    status = "pass";
+                } else {
+                    status = "fail";
+                    failures++;
+                    write_png((failure_dir / (csv_path.stem().string() + "_" + scene + "_" + MODE_NAMES[mode] + ".png")).string(), *result);
+                }
+            }
+
+            std::cout << (status == "pass" ? "PASS " : status == "no_reference" ? "RUN  " : "FAIL ") << scene << " "
+                      << MODE_NAMES[mode] << " " << run.wall_ms << " ms " << run.peak_rss_kb << " kB";
+            if (!mismatch_column.empty())
+                std::cout << " mismatch " << mismatch_column << " psnr " << psnr_column;
+            std::cout << std::endl;
+            csv << scene << "," << MODE_NAMES[mode] << "," << width << "," << height << "," << run.wall_ms << ","
+                << run.peak_rss_kb << "," << status << "," << mismatch_column << "," << psnr_column << "\n";
+        }
+    }
+
+    std::cout << (failures ? "FAILED " : "OK ") << failures << " failure(s), timings in " << csv_path.string() << std::endl;
+    return failures ? 1 : 0;
+}
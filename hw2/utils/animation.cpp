@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <iostream>
+#include <sstream>
+#include <Eigen/Dense>
+#include "animation.h"
+#include "profiler.h"
+
+namespace animation {
+
+namespace {
+
+Eigen::Quaterniond orientation_quaternion(const scene::Camera& camera) {
+    Eigen::Vector3d axis = camera.orientation.head<3>();
+    if (axis.norm() == 0.0)
+        return Eigen::Quaterniond::Identity();
+    return Eigen::Quaterniond(Eigen::AngleAxisd(camera.orientation(3), axis.normalized()));
+}
+
+// Write one frame to disk
+bool write_frame(const ppm_image::PPMImage<float>& image, const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    image.serialize(file);
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+
+std::optional<CameraPath> CameraPath::load(const std::string& filename, const scene::Camera& base) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open camera path " << filename << std::endl;
+        return std::nullopt;
+    }
+
+    CameraPath path;
+    scene::Camera key = base;
+    bool in_block = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            if (in_block && line.empty()) {
+                path.keys.push_back(key);
+                key = base;
+                in_block = false;
+            }
+            continue;
+        }
+        std::istringstream iss(line);
+        key.fill_field(iss);
+        in_block = true;
+    }
+    if (in_block)
+        path.keys.push_back(key);
+
+    if (path.keys.empty()) {
+        std::cerr << "Error: Camera path " << filename << " has no keyframe" << std::endl;
+        return std::nullopt;
+    }
+    return path;
+}
+
+scene::Camera CameraPath::at(double t) const {
+    if (keys.size() == 1)
+        return keys.front();
+
+    double segment = std::clamp(t, 0.0, 1.0) * (keys.size() - 1);
+    std::size_t i = std::min(static_cast<std::size_t>(segment), keys.size() - 2);
+    double u = segment - i;
+    const scene::Camera& a = keys[i];
+    const scene::Camera& b = keys[i + 1];
+
+    scene::Camera camera = a;
+    camera.position = (1.0 - u) * a.position + u * b.position;
+    camera.n = (1.0 - u) * a.n + u * b.n;
+    camera.f = (1.0 - u) * a.f + u * b.f;
+    camera.l = (1.0 - u) * a.l + u * b.l;
+    camera.r = (1.0 - u) * a.r + u * b.r;
+    camera.t = (1.0 - u) * a.t + u * b.t;
+    camera.b = (1.0 - u) * a.b + u * b.b;
+
+    Eigen::AngleAxisd orientation(orientation_quaternion(a).slerp(u, orientation_quaternion(b)));
+    camera.orientation << orientation.axis(), orientation.angle();
+    return camera;
+}
+
+std::string frame_filename(const std::string& prefix, int frame) {
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%04d.ppm", frame);
+    return prefix + number;
+}
+
+bool render_sequence(const scene::SceneFile& scene, const CameraPath& path, int frames, int width, int height,
+                     scene::SceneFile::RenderMode mode, const rendering::RenderOptions& options,
+                     const std::string& prefix, int threads, int frames_in_flight) {
+    const int samples = scene::SceneFile::buffer_samples(mode, options);
+    const int worker_count = std::max(1, std::min(threads, frames));
+    const int slot_count = std::max(1, frames_in_flight);
+
+    // Every frame in flight owns one slot of framebuffers from the moment a worker starts it until it is written
+    std::vector<scene::FrameBuffers> buffers;
+    buffers.reserve(slot_count);
+    for (int i = 0; i < slot_count; i++)
+        buffers.emplace_back(width, height, samples);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<int> free_slots;
+    for (int i = slot_count - 1; i >= 0; i--)
+        free_slots.push_back(i);
+    std::deque<std::pair<int, int>> rendered;   // (frame, slot) waiting to be written
+    int next_frame = 0;
+    int finished_workers = 0;
+
+    // Workers do not see the session of the calling thread, each records into its own stats that are merged at the end
+    profiler::Stats* caller_stats = profiler::active();
+    std::vector<profiler::Stats> worker_stats(worker_count);
+
+    auto worker = [&](int w) {
+        profiler::Session session(caller_stats ? &worker_stats[w] : nullptr);
+        while (true) {
+            int frame, slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return !free_slots.empty() || next_frame >= frames; });
+                if (next_frame >= frames)
+                    break;
+                frame = next_frame++;
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+
+            scene.render_into(buffers[slot], mode, options, path.frame(frame, frames));
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                rendered.emplace_back(frame, slot);
+            }
+            changed.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished_workers++;
+        }
+        changed.notify_all();
+    };
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < worker_count; w++)
+        workers.emplace_back(worker, w);
+
+    // The calling thread writes the frames in the order they finish and hands their slots back
+    bool ok = true;
+    while (true) {
+        int frame, slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return !rendered.empty() || finished_workers == worker_count; });
+            if (rendered.empty())
+                break;
+            std::tie(frame, slot) = rendered.front();
+            rendered.pop_front();
+        }
+
+        {
+            profiler::ScopedTimer timer(profiler::SERIALIZE);
+            ok = write_frame(buffers[slot].image, frame_filename(prefix, frame)) && ok;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_slots.push_back(slot);
+        }
+        changed.notify_all();
+    }
+
+    for (auto& thread : workers)
+        thread.join();
+    if (caller_stats) {
+        for (const auto& stats : worker_stats)
+            caller_stats->merge(stats);
+    }
+    return ok;
+}
+
+} // namespace animation
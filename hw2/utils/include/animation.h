@@ -0,0 +1,55 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "scene.h"
+
+
+namespace animation {
+
+    // Keyframed camera path. The file holds one camera block per keyframe, separated by empty lines, with the same
+    // fields as the camera block of a scene file:
+    //     position 0 0 5
+    //     orientation 0 1 0 0
+    //
+    //     position 5 0 0
+    //     orientation 0 1 0 1.5708
+    // Fields a block leaves out are taken from the scene camera. Frames are spread evenly over the keyframes,
+    // positions and frustum bounds are interpolated linearly and orientations with quaternion slerp.
+    struct CameraPath {
+        std::vector<scene::Camera> keys;
+
+        // Returns std::nullopt if the file can not be read or has no keyframe
+        static std::optional<CameraPath> load(const std::string& filename, const scene::Camera& base);
+
+        // Camera at t in [0, 1] along the path
+        scene::Camera at(double t) const;
+
+        // Camera of frame i out of frames
+        scene::Camera frame(int i, int frames) const {
+            return at(frames > 1 ? static_cast<double>(i) / (frames - 1) : 0.0);
+        }
+    };
+
+    // File name of one frame, <prefix>_0007.ppm
+    std::string frame_filename(const std::string& prefix, int frame);
+
+    /* Render frames along a camera path from one loaded scene and write each one to frame_filename(prefix, i).
+        Frames are independent, so up to threads workers render different frames at once. Each frame in flight holds
+        one set of FrameBuffers from the start of its rendering until the calling thread has written it to disk,
+        frames_in_flight sets how many sets exist and so bounds the memory use. The scene and its meshes are shared
+        read only by all workers.
+        @param threads: number of rendering threads, the calling thread only writes frames
+        @param frames_in_flight: framebuffer sets, one more than threads keeps writing off the rendering path
+        @return false if writing any frame failed
+    */
+    bool render_sequence(const scene::SceneFile& scene, const CameraPath& path, int frames, int width, int height,
+                         scene::SceneFile::RenderMode mode, const rendering::RenderOptions& options,
+                         const std::string& prefix, int threads = 1, int frames_in_flight = 2);
+
+} // namespace animation
+
+#endif // ANIMATION_H
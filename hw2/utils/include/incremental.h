@@ -0,0 +1,67 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include "scene.h"
+
+
+namespace scene {
+
+    // Keeps the last frame of a scene and redraws only what changed, for previews where a few objects are edited
+    // between frames. Edit scene.objects[i].transform or its material, then call update().
+    //
+    // Every object's state and screen_bounds() of the last frame are remembered. An object whose transform, material
+    // or culling changed dirties the union of its old and new bounds. The dirty rectangle is cleared and re-rasterized
+    // with a scissor, drawing only the objects whose bounds overlap it. The result is identical to a full render.
+    // A changed camera, light set or object count, the EDGES mode (lines are not scissored), the RAYTRACE mode
+    // (reflections can show any object) and moving geometry with shadows enabled (shadows can land anywhere) fall
+    // back to a full render.
+    class IncrementalRenderer {
+    public:
+        IncrementalRenderer(const SceneFile& scene, int width, int height, SceneFile::RenderMode mode,
+                            const rendering::RenderOptions& options = rendering::RenderOptions());
+
+        // Bring the image up to date with the scene, the first call renders everything
+        const ppm_image::PPMImage<float>& update();
+
+        const ppm_image::PPMImage<float>& image() const {
+            return buffers.image;
+        }
+
+        // Pixels redrawn by the last update(), empty when nothing changed
+        const std::vector<rendering::ScreenRect>& dirty_rects() const {
+            return last_dirty;
+        }
+
+    private:
+        // What an object looked like in the last frame
+        struct ObjectState {
+            const models::ObjModel* obj_file;
+            Eigen::Matrix4d transform;
+            ppm_image::Pixel<float> ambient, diffuse, specular;
+            float shininess;
+            models::CullMode cull;
+            rendering::ScreenRect bounds;
+        };
+
+        ObjectState capture(const models::Model& object) const;
+        bool same_geometry(const ObjectState& a, const ObjectState& b) const;
+        bool same_material(const ObjectState& a, const ObjectState& b) const;
+        bool same_lights() const;
+        void full_render();
+
+        const SceneFile& scene;
+        SceneFile::RenderMode mode;
+        rendering::RenderOptions options;
+        FrameBuffers buffers;
+        bool rendered = false;
+        Camera last_camera;
+        std::vector<PointLight> last_lights;
+        std::vector<ObjectState> last_objects;
+        std::vector<rendering::ScreenRect> last_dirty;
+    };
+
+} // namespace scene
+
+#endif // INCREMENTAL_H
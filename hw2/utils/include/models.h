@@ -9,12 +9,31 @@
 #include <variant>
 #include <memory>
 #include <optional>
+#include <sstream>
+#include <iostream>
 #include <Eigen/Dense>
 #include "ppm_image.h"
 
 // These model classes are only containers providing data storage, io and type conversions, transformation logic should be implemented elsewhere
 namespace models{
 
+// Which faces are skipped before rasterization, set per object with a "cull back|front|none|silhouette" line in the scene file
+enum CullMode {
+    CULL_DEFAULT,       // back faces for the shaded modes, nothing for wireframes
+    CULL_BACK,
+    CULL_FRONT,
+    CULL_NONE,
+    CULL_SILHOUETTE     // wireframes only draw edges between a front and a back face, shaded modes treat it as CULL_BACK
+};
+
+inline std::optional<CullMode> parse_cull_mode(const std::string& name) {
+    if (name == "back") return CULL_BACK;
+    if (name == "front") return CULL_FRONT;
+    if (name == "none") return CULL_NONE;
+    if (name == "silhouette") return CULL_SILHOUETTE;
+    return std::nullopt;
+}
+
 // Object file class that stores the vertexes and faces, and support laoding from .obj file by calling load_from_obj_file()
 struct ObjModel {
 
@@ -24,13 +43,29 @@ struct ObjModel {
     using vertexList = std::vector<Eigen::Vector3d>;
     using FaceList = std::vector<Face>;
 
+    constexpr static std::size_t NO_FACE = -1;
+
+    // An edge between two vertexes, stored with the smaller vertex index first, together with the
+    // (up to two) faces sharing it. f1 is NO_FACE for edges on the boundary of an open mesh
+    struct Edge {
+        std::size_t v0;
+        std::size_t v1;
+        std::size_t f0;
+        std::size_t f1;
+    };
+    using EdgeList = std::vector<Edge>;
+
     void clear() {
         vertexes.clear();
         faces.clear();
+        edges.clear();
     }
 
     bool load_from_obj_file(const std::string& filename);
 
+    // Collect the edges of the faces, an edge shared by two faces is only kept once
+    static EdgeList compute_unique_edges(const FaceList& faces);
+
     Eigen::Matrix4Xd export_vertexes_matrix_homo(){
         const int num_cols = static_cast<int>(vertexes.size());
         Eigen::Matrix4Xd M(4, num_cols);
@@ -77,11 +112,18 @@ struct ObjModel {
             const double z = matrix(2, i) * inv_w;
             vertexes.emplace_back(x, y, z);
         }
+        vertexes_homo = export_vertexes_matrix_homo();
     }
     
     vertexList vertexes;
     vertexList normals;
     FaceList faces;
+    EdgeList edges;     // unique edges of the faces, built once in load_from_obj_file()
+    Eigen::Vector3d bound_min = Eigen::Vector3d::Zero();    // object space bounding box, built in load_from_obj_file()
+    Eigen::Vector3d bound_max = Eigen::Vector3d::Zero();
+    // vertexes and normals as matrix columns, shared by all instances, built once in load_from_obj_file()
+    Eigen::Matrix4Xd vertexes_homo;
+    Eigen::Matrix3Xd normals_matrix;
     std::string filename;
 };
 
@@ -94,6 +136,9 @@ struct Model {
     ppm_image::Pixel<float> diffuse;
     ppm_image::Pixel<float> specular;
     float shininess;
+    CullMode cull = CULL_DEFAULT;
+    // Share of the mirror reflection the ray tracer adds to the color, set with a "reflectivity r g b" line
+    ppm_image::Pixel<float> reflectivity;
 
     Model(const std::shared_ptr<ObjModel>& init_obj, Eigen::Matrix4d init_transform = Eigen::Matrix4d::Identity(), std::string model_name = ""): 
     obj_file(init_obj), name(model_name), transform(init_transform) { }
@@ -107,12 +152,26 @@ struct Model {
         return obj_file->faces;
     }
 
+    // get the unique edges from the obj file
+    const ObjModel::EdgeList& edges() const {
+        return obj_file->edges;
+    }
+
+    // World space bounding sphere of the instance, derived from the object space bounding box of the obj file
+    std::pair<Eigen::Vector3d, double> bounding_sphere() const {
+        Eigen::Vector3d center = 0.5 * (obj_file->bound_min + obj_file->bound_max);
+        double radius = 0.5 * (obj_file->bound_max - obj_file->bound_min).norm();
+        double max_scale = transform.block<3,3>(0,0).colwise().norm().maxCoeff();
+        Eigen::Vector3d world_center = transform.block<3,3>(0,0) * center + transform.block<3,1>(0,3);
+        return {world_center, radius * max_scale};
+    }
+
     Eigen::Matrix4Xd points_homo_transformed() const {
-        return transform * (obj_file->export_vertexes_matrix_homo());
+        return transform * obj_file->vertexes_homo;
     }
 
     Eigen::Matrix3Xd normals_transformed() const {
-        Eigen::Matrix3Xd transformed_normals = transform.block<3,3>(0,0) * (obj_file->export_normals_matrix());
+        Eigen::Matrix3Xd transformed_normals = transform.block<3,3>(0,0) * obj_file->normals_matrix;
         
         // Normalize each normal vector
         for (int i = 0; i < transformed_normals.cols(); ++i) {
@@ -141,6 +200,20 @@ struct Model {
             line >> shininess;
             return true;
         }
+        if (field_name == "reflectivity") {
+            line >> reflectivity.r >> reflectivity.g >> reflectivity.b;
+            return true;
+        }
+        if (field_name == "cull") {
+            std::string mode_name;
+            line >> mode_name;
+            std::optional<CullMode> mode = parse_cull_mode(mode_name);
+            if (mode.has_value())
+                cull = mode.value();
+            else
+                std::cerr << "Error: Unknown cull mode \"" << mode_name << "\"" << std::endl;
+            return true;
+        }
         return false;
     }
 };
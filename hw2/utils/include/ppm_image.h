@@ -155,6 +155,12 @@ public:
         return &data[y * width];
     }
     
+    // Set every pixel to one color, used to reuse an image for the next frame
+    void fill(const Pixel<T>& color) {
+        for (std::size_t i = 0; i < width * height; ++i)
+            data[i] = color;
+    }
+
     // Get dimensions
     std::size_t w() const { return width; }
     std::size_t h() const { return height; }
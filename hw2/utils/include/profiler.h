@@ -0,0 +1,267 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+
+// Instrumentation of the rendering pipeline. Timers and counters only record while a Session is open on the
+// current thread, otherwise they cost a thread local pointer check.
+namespace profiler {
+
+    // Pipeline stages, the time of a stage excludes the time of the stages nested inside it
+    enum Stage {
+        CULLING,            // frustum culling and ordering of the instances
+        VERTEX_TRANSFORM,   // model to world transform of the vertexes and normals
+        PROJECTION,         // world to ndc
+        TRIANGLE_SETUP,     // culling, screen mapping and bounding boxes
+        COVERAGE,           // barycentric and depth tests of the pixels in the bounding boxes
+        SHADING,            // lighting, at the vertexes for Gouraud and at the fragments for Phong
+        SHADOW_MAPS,        // depth passes of the shadow cube maps
+        ACCEL_BUILD,        // bounding volume hierarchies of the ray tracer
+        RAY_TRAVERSAL,      // ray tracer hierarchy traversal and triangle tests
+        RESOLVE,            // multisample resolve
+        SERIALIZE,          // PPMImage::serialize
+        STAGE_COUNT
+    };
+
+    enum Counter {
+        INSTANCES_CULLED,       // objects outside the view frustum
+        TRIANGLES_CULLED,       // dropped by face culling
+        TRIANGLES_RASTERIZED,
+        FRAGMENTS_TESTED,       // pixels (or samples with multisampling) inside a triangle
+        FRAGMENTS_SHADED,       // fragments that passed the depth test and were shaded
+        OVERDRAW,               // shaded fragments that replaced an earlier fragment of the same pixel
+        RAYS,                   // primary, shadow and reflection rays of the ray tracer
+        COUNTER_COUNT
+    };
+
+    inline const char* stage_name(Stage stage) {
+        static const char* names[STAGE_COUNT] = {
+            "culling", "vertex_transform", "projection", "triangle_setup", "coverage", "shading", "shadow_maps", "accel_build", "ray_traversal", "resolve", "serialize"};
+        return names[stage];
+    }
+
+    inline const char* counter_name(Counter counter) {
+        static const char* names[COUNTER_COUNT] = {
+            "instances_culled", "triangles_culled", "triangles_rasterized", "fragments_tested", "fragments_shaded", "overdraw", "rays"};
+        return names[counter];
+    }
+
+    struct Stats {
+        std::array<double, STAGE_COUNT> seconds{};
+        std::array<std::uint64_t, COUNTER_COUNT> counts{};
+
+        void add(Counter counter, std::uint64_t n) {
+            counts[counter] += n;
+        }
+
+        // Add the times and counts recorded by another thread
+        void merge(const Stats& other) {
+            for (int s = 0; s < STAGE_COUNT; s++)
+                seconds[s] += other.seconds[s];
+            for (int c = 0; c < COUNTER_COUNT; c++)
+                counts[c] += other.counts[c];
+        }
+
+        // One JSON object with the stage times in milliseconds and the counters
+        void write_json(std::ostream& os) const {
+            double total = 0.0;
+            os << "{\"stages_ms\": {";
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                os << (s ? ", " : "") << "\"" << stage_name(static_cast<Stage>(s)) << "\": " << seconds[s] * 1e3;
+                total += seconds[s];
+            }
+            os << "}, \"total_ms\": " << total * 1e3 << ", \"counters\": {";
+            for (int c = 0; c < COUNTER_COUNT; c++)
+                os << (c ? ", " : "") << "\"" << counter_name(static_cast<Counter>(c)) << "\": " << counts[c];
+            os << "}}" << std::endl;
+        }
+    };
+
+    class ScopedTimer;
+
+    // Per thread recording state: the stats being filled and the innermost running timer
+    struct ThreadState {
+        Stats* stats = nullptr;
+        ScopedTimer* current = nullptr;
+    };
+
+    inline ThreadState& thread_state() {
+        thread_local ThreadState state;
+        return state;
+    }
+
+    inline Stats* active() {
+        return thread_state().stats;
+    }
+
+    // Record into stats on this thread until the session ends, nullptr pauses recording
+    class Session {
+    public:
+        explicit Session(Stats* stats): previous(thread_state()) {
+            thread_state() = ThreadState{stats, nullptr};
+        }
+        ~Session() {
+            thread_state() = previous;
+        }
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+    private:
+        ThreadState previous;
+    };
+
+    // Add the time until the end of the scope to a stage, minus the time spent in timers nested inside it
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Stage stage): stage(stage), stats(active()) {
+            if (!stats)
+                return;
+            parent = thread_state().current;
+            thread_state().current = this;
+            start = std::chrono::steady_clock::now();
+        }
+
+        ~ScopedTimer() {
+            if (!stats)
+                return;
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            // Sampled estimates can overshoot on very short scopes, a stage never goes negative
+            stats->seconds[stage] += std::max(0.0, elapsed - nested);
+            if (parent)
+                parent->nested += elapsed;
+            thread_state().current = parent;
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        // Take time measured some other way, e.g. by a SampledTimer, out of this stage
+        void exclude(double seconds) {
+            nested += seconds;
+        }
+
+        // Time of this stage so far, without the time taken out of it, 0 when not recording
+        double own_seconds() const {
+            if (!stats)
+                return 0.0;
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - nested;
+        }
+
+    private:
+        Stage stage;
+        Stats* stats;
+        ScopedTimer* parent = nullptr;
+        double nested = 0.0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /* Time of a stage inside a hot loop, e.g. shading per fragment: reading the clock around every call would cost
+        about as much as the work, so only one call in SAMPLE_INTERVAL is timed and the total is extrapolated from
+        the number of calls. Loops pick Scope<false> when no session is recording, which compiles to nothing.
+    */
+    class SampledTimer {
+    public:
+        static constexpr std::uint64_t SAMPLE_INTERVAL = 64;
+
+        explicit SampledTimer(Stage stage): stage(stage), stats(active()) { }
+
+        SampledTimer(const SampledTimer&) = delete;
+        SampledTimer& operator=(const SampledTimer&) = delete;
+
+        bool recording() const {
+            return stats != nullptr;
+        }
+
+        // One call of the stage, until the end of the scope
+        template <bool ENABLED>
+        class Scope {
+        public:
+            explicit Scope(SampledTimer& timer): timer(timer) {
+                if constexpr (ENABLED) {
+                    if (timer.calls++ % SAMPLE_INTERVAL == 0) {
+                        sampled = true;
+                        start = std::chrono::steady_clock::now();
+                    }
+                }
+            }
+
+            ~Scope() {
+                if constexpr (ENABLED) {
+                    if (!sampled)
+                        return;
+                    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    timer.sampled_seconds += std::max(0.0, elapsed - clock_overhead());
+                    timer.samples++;
+                }
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            SampledTimer& timer;
+            bool sampled = false;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        // Shortest time between two clock reads, which every sample measures on top of the call itself. Calls in hot
+        // loops take tens of nanoseconds, about as long as a clock read.
+        static double clock_overhead() {
+            static const double overhead = [] {
+                double shortest = std::numeric_limits<double>::infinity();
+                for (int i = 0; i < 64; i++) {
+                    auto start = std::chrono::steady_clock::now();
+                    shortest = std::min(shortest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                }
+                return shortest;
+            }();
+            return overhead;
+        }
+
+        // Estimated time of all the calls so far
+        double estimate() const {
+            return samples ? sampled_seconds * calls / samples : 0.0;
+        }
+
+        /* Add the estimates of timers sampled inside enclosing to their stages and take them out of it. Estimates
+            of short runs can add up to more than enclosing measured, they are then scaled down together to fit.
+        */
+        static void report(ScopedTimer& enclosing, std::initializer_list<const SampledTimer*> timers) {
+            double total = 0.0;
+            for (const SampledTimer* timer : timers)
+                total += timer->stats ? timer->estimate() : 0.0;
+            if (total <= 0.0)
+                return;
+            const double scale = std::min(1.0, std::max(0.0, enclosing.own_seconds()) / total);
+            for (const SampledTimer* timer : timers) {
+                if (!timer->stats)
+                    continue;
+                const double seconds = timer->estimate() * scale;
+                timer->stats->seconds[timer->stage] += seconds;
+                enclosing.exclude(seconds);
+            }
+        }
+
+    private:
+        Stage stage;
+        Stats* stats;
+        std::uint64_t calls = 0;
+        std::uint64_t samples = 0;
+        double sampled_seconds = 0.0;
+    };
+
+    // Add to a counter if a session is recording
+    inline void count(Counter counter, std::uint64_t n = 1) {
+        if (Stats* stats = active())
+            stats->add(counter, n);
+    }
+
+} // namespace profiler
+
+#endif // PROFILER_H
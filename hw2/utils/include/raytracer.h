@@ -0,0 +1,139 @@
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <Eigen/Dense>
+#include "models.h"
+#include "rendering.h"
+#include "instance_bvh.h"
+
+// Forward declarations
+namespace scene {
+    struct PointLight;
+    struct Camera;
+}
+
+
+// CPU ray tracer over the same scenes, materials and lighting() as the rasterizer, with hard shadows and mirror
+// reflections. Rays are traced in packets of four through a two level hierarchy: one BVH per obj file in object
+// space, shared by its instances, and one over the instances in world space.
+namespace raytracing {
+
+    // Four rays traced together, one per SIMD lane. The rays of a packet start close to each other and point in
+    // similar directions (a 2x2 pixel block, or the shadow and reflection rays of such a block), so they mostly
+    // visit the same nodes and one node test serves all of them.
+    struct RayPacket {
+        static constexpr int SIZE = 4;
+        using Lanes = Eigen::Array<double, SIZE, 1>;
+        using Mask = Eigen::Array<bool, SIZE, 1>;
+
+        // Origins and directions, the directions are not normalized and t is measured in units of their length.
+        // Inactive lanes still go through the arithmetic, masked out afterwards, so every lane holds a value.
+        Lanes ox = Lanes::Zero(), oy = Lanes::Zero(), oz = Lanes::Zero();
+        Lanes dx = Lanes::Zero(), dy = Lanes::Zero(), dz = Lanes::Zero();
+        Lanes t_min = Lanes::Zero(), t_max = Lanes::Zero();
+        Mask active = Mask::Constant(false);
+    };
+
+    // Closest hit of every lane of a packet
+    struct PacketHit {
+        RayPacket::Mask hit = RayPacket::Mask::Constant(false);
+        RayPacket::Lanes t = RayPacket::Lanes::Zero();
+        // Barycentric coordinates of vertexes 1 and 2 of the face
+        RayPacket::Lanes u = RayPacket::Lanes::Zero(), v = RayPacket::Lanes::Zero();
+        std::array<std::size_t, RayPacket::SIZE> object{};
+        std::array<std::size_t, RayPacket::SIZE> face{};
+    };
+
+    // Bounding volume hierarchy over a list of boxes, built top down with the binned surface area heuristic
+    class BVH {
+    public:
+        // Candidate split planes per axis and node
+        static constexpr int BINS = 12;
+        // Nodes with this many primitives or fewer become leaves when splitting does not pay off
+        static constexpr std::size_t MAX_LEAF_SIZE = 8;
+        // Cost of visiting a node relative to intersecting one primitive
+        static constexpr double TRAVERSAL_COST = 1.0;
+        // Deepest node, traversal stacks hold MAX_DEPTH + 1 entries. Nodes past half of it split at the median
+        // instead of the best plane, which bounds the depth for any number of primitives that fits in memory.
+        static constexpr int MAX_DEPTH = 63;
+
+        // Inner nodes keep their first child right after themselves and the second at first, leaves hold count
+        // primitives starting at order[first]. axis is the split axis, used to visit the nearer child first.
+        struct Node {
+            scene::AABB bounds;
+            std::uint32_t first = 0;
+            std::uint32_t count = 0;
+            int axis = 0;
+        };
+
+        BVH() = default;
+        explicit BVH(const std::vector<scene::AABB>& boxes);
+
+        std::vector<Node> nodes;
+        std::vector<std::size_t> order;     // primitive indices in leaf order
+
+    private:
+        std::size_t build(std::size_t begin, std::size_t end, const std::vector<scene::AABB>& boxes,
+                          const std::vector<Eigen::Vector3d>& centers, int depth);
+    };
+
+    // Triangles of one obj file in object space, stored in the leaf order of their BVH as a vertex and two edges
+    struct MeshAccel {
+        explicit MeshAccel(const models::ObjModel& obj);
+
+        BVH bvh;
+        std::vector<Eigen::Vector3d> v0, e1, e2;
+        std::vector<std::size_t> face;          // face index in the obj file of each stored triangle
+    };
+
+    // Acceleration structure of a whole scene, built once and shared read only by all tracing threads
+    class SceneAccel {
+    public:
+        // Mesh hierarchies of previous are reused for the obj files it already covers, so moving objects only
+        // rebuilds the instance level
+        explicit SceneAccel(const std::vector<models::Model>& objects, const SceneAccel* previous = nullptr);
+
+        // Closest hit of every active lane within [t_min, t_max]
+        PacketHit intersect(const RayPacket& packet) const;
+
+        // Whether each active lane hits anything within [t_min, t_max], lanes stop at their first hit
+        RayPacket::Mask occluded(const RayPacket& packet) const;
+
+        // World to object transform of each instance, index into meshes of its obj file
+        struct Instance {
+            Eigen::Matrix4d object_from_world;
+            std::size_t mesh;
+        };
+
+        std::vector<std::shared_ptr<const MeshAccel>> meshes;
+        // obj file of each mesh, held so that a later obj file cannot reuse its address and match a stale mesh
+        std::vector<std::shared_ptr<const models::ObjModel>> mesh_sources;
+        std::vector<Instance> instances;
+        BVH top;                                // over the world bounds of the instances
+
+    private:
+        template <bool ANY_HIT>
+        void traverse(const RayPacket& packet, PacketHit& hit) const;
+    };
+
+    // Width and height in pixels of the image tiles handed out to the tracing threads
+    constexpr int TILE_SIZE = 16;
+
+    /* Ray trace the scene into the image, one primary ray per pixel and coverage sample (the multisample pattern
+        of options.samples), averaged per pixel. Every hit is shaded with rendering::lighting() using only the lights
+        its shadow rays reach, plus reflectivity times the color seen along the mirror direction, up to
+        options.reflection_depth bounces. Primary rays are limited to the camera near and far planes like the
+        rasterizer. Tiles of TILE_SIZE pixels are shared among options.threads threads.
+        @param image: row 0 at ndc y = -1 like the z buffer
+    */
+    void render(ppm_image::PPMImage<float>& image, const std::vector<models::Model>& objects,
+                const std::vector<scene::PointLight>& lights, const scene::Camera& camera,
+                const rendering::RenderOptions& options, const SceneAccel& accel);
+
+} // namespace raytracing
+
+#endif // RAYTRACER_H
@@ -2,7 +2,10 @@
 #define RENDERING_H
 
 #include <utility>
+#include <algorithm>
 #include <vector>
+#include <optional>
+#include <cmath>
 #include <Eigen/Dense>
 #include "ppm_image.h"
 #include "models.h"
@@ -17,9 +20,169 @@ namespace scene {
 
 namespace rendering {
 
+    struct ShadowCubeMap;
+
     constexpr bool ENABLE_ANTIALIASING = false;
 
-    
+    // Line rasterizers that can be picked at runtime for the wireframe mode
+    enum LineMode {
+        BRESENHAM,      // integer Bresenham, antialiasing controlled by ENABLE_ANTIALIASING at compile time
+        XIAOLIN_WU      // Xiaolin Wu's antialiased lines with sub-pixel endpoints
+    };
+
+    // How the specular power pow(n.h, shininess) is evaluated
+    enum SpecularMode {
+        SPECULAR_EXACT,     // std::pow for every light at every shaded point
+        SPECULAR_TABLE      // per-material SpecularTable, falls back to std::pow when its error bound is too large
+    };
+
+    // Runtime settings shared by all objects of one SceneFile::render() call
+    struct RenderOptions {
+        // Coverage samples per pixel for the shaded modes, 1 disables multisampling. Supports 1, 2, 4 and 8
+        int samples = 1;
+        // Line rasterizer for the EDGES mode
+        LineMode line_mode = BRESENHAM;
+        // Evaluate lighting with the vectorized PackedLights kernel (single precision) instead of the exact per-light loop
+        bool packed_lights = false;
+        // Specular power evaluation, SPECULAR_EXACT keeps the reference results
+        SpecularMode specular_mode = SPECULAR_EXACT;
+        // Shadow cube maps for every light in the shaded modes, and the width of each cube face in texels
+        bool shadows = false;
+        int shadow_resolution = 512;
+        // Ray tracer only: worker threads sharing the image tiles, and how many mirror bounces a ray may take
+        int threads = 1;
+        int reflection_depth = 2;
+    };
+
+    // Lookup table of x^shininess on [0, 1] with linear interpolation between the entries.
+    // The interpolation error is measured against std::pow when the table is built: every interval is checked at
+    // SpecularTable::CHECKS_PER_INTERVAL evenly spaced points. For shininess >= 2 it is also bounded analytically by
+    // h^2 / 8 * shininess * (shininess - 1), h = 1 / (SIZE - 1), about 6.7e-7 for shininess 10 and 7.4e-5 for 100.
+    // Lookups never differ from std::pow by more than TOLERANCE (a quarter of an 8 bit color step):
+    //  - shininess below 1 has a steep start at 0, the leading intervals above the tolerance are evaluated with std::pow
+    //  - shininess above about 360 exceeds the tolerance near 1, the table is dropped and every lookup calls std::pow
+    struct SpecularTable {
+        static constexpr std::size_t SIZE = 4096;
+        static constexpr int CHECKS_PER_INTERVAL = 16;
+        static constexpr double TOLERANCE = 1.0 / 1024.0;
+
+        explicit SpecularTable(float shininess);
+
+        // x^shininess for x in (0, 1], values slightly above 1 from rounding are clamped
+        double operator()(double x) const {
+            if (values.empty() || x < exact_below)
+                return std::pow(x, static_cast<double>(shininess));
+            double t = std::min(x, 1.0) * (SIZE - 1);
+            std::size_t i = static_cast<std::size_t>(t);
+            if (i >= SIZE - 1)
+                return values[SIZE - 1];
+            double f = t - i;
+            return values[i] + f * (values[i + 1] - values[i]);
+        }
+
+        // Whether lookups go through the table, false when the error bound was exceeded
+        bool tabulated() const {
+            return !values.empty();
+        }
+
+        float shininess;
+        double max_error;       // largest measured difference to std::pow over the tabulated range
+        double exact_below;     // lookups below this go to std::pow
+        std::vector<float> values;
+    };
+
+    // Number of lights the lighting() overload taking PackedLights evaluates per iteration, the light arrays are
+    // padded to a multiple of it
+    constexpr std::size_t LIGHT_LANES = 8;
+
+    // Point lights as a structure of float arrays, so that the lighting kernel can evaluate LIGHT_LANES lights
+    // at once with plain loops the compiler turns into SIMD code. Padding lanes have zero color and never pass
+    // the influence test.
+    struct PackedLights {
+        explicit PackedLights(const std::vector<scene::PointLight>& lights);
+
+        std::size_t count;      // number of real lights
+        std::vector<float> x, y, z;
+        std::vector<float> r, g, b;
+        std::vector<float> k;
+        std::vector<float> radius_squared;
+        std::vector<const ShadowCubeMap*> shadows;     // null for lights without shadow map and for padding
+        bool has_shadows = false;
+    };
+
+    // Inclusive pixel rectangle in z buffer coordinates (row 0 at ndc y = -1), used as scissor and dirty region
+    struct ScreenRect {
+        int xmin;
+        int ymin;
+        int xmax;
+        int ymax;
+
+        static ScreenRect full(std::size_t width, std::size_t height) {
+            return {0, 0, static_cast<int>(width) - 1, static_cast<int>(height) - 1};
+        }
+
+        bool empty() const {
+            return xmin > xmax || ymin > ymax;
+        }
+
+        bool intersects(const ScreenRect& other) const {
+            return !empty() && !other.empty() && xmin <= other.xmax && other.xmin <= xmax &&
+                   ymin <= other.ymax && other.ymin <= ymax;
+        }
+
+        // Smallest rectangle containing both, an empty rectangle does not grow the other one
+        ScreenRect united(const ScreenRect& other) const {
+            if (empty())
+                return other;
+            if (other.empty())
+                return *this;
+            return {std::min(xmin, other.xmin), std::min(ymin, other.ymin),
+                    std::max(xmax, other.xmax), std::max(ymax, other.ymax)};
+        }
+
+        ScreenRect clipped(std::size_t width, std::size_t height) const {
+            return {std::max(xmin, 0), std::max(ymin, 0),
+                    std::min(xmax, static_cast<int>(width) - 1), std::min(ymax, static_cast<int>(height) - 1)};
+        }
+
+        bool operator==(const ScreenRect& other) const {
+            return xmin == other.xmin && ymin == other.ymin && xmax == other.xmax && ymax == other.ymax;
+        }
+    };
+
+    // Conservative pixel bounds of everything render_object() can draw for the model, from its bounding box.
+    // Returns the full screen when a corner of the box is behind the camera and an empty rectangle when it is off screen.
+    ScreenRect screen_bounds(const models::Model& model, const scene::Camera& camera, std::size_t width, std::size_t height);
+
+    // Sub-pixel sample offsets from the pixel center (standard D3D patterns), returns an empty list for unsupported counts
+    const std::vector<std::pair<double, double>>& sample_pattern(int samples);
+
+    // Color and depth storage holding one entry per coverage sample. Objects are rasterized into it
+    // with render_object() and resolve() averages the samples down to a regular image afterwards.
+    struct MultisampleBuffer {
+        MultisampleBuffer(std::size_t height, std::size_t width, int samples);
+
+        std::size_t index(std::size_t y, std::size_t x, int s) const {
+            return (y * width + x) * samples + s;
+        }
+
+        // Average the samples of each pixel into the image
+        void resolve(ppm_image::PPMImage<float>& image) const;
+
+        // Reset to black samples at the far plane
+        void clear();
+
+        // Same as clear() and resolve() for the pixels of one rectangle only
+        void clear(const ScreenRect& rect);
+        void resolve(ppm_image::PPMImage<float>& image, const ScreenRect& rect) const;
+
+        std::size_t width;
+        std::size_t height;
+        int samples;
+        std::vector<ppm_image::Pixel<float>> colors;
+        std::vector<double> depths;
+    };
+
     inline double barycentric_f(float xi, float xj, float yi, float yj, float x, float y) {
         return (yi-yj)*x + (xj-xi)*y + xi*yj - xj*yi;
     }
@@ -47,6 +210,11 @@ namespace rendering {
         return {x, y};
     }
 
+    // Same mapping as ndc_to_screen() but keeps the sub-pixel position, used for multisampling
+    inline std::pair<double, double> ndc_to_screen_subpixel(const Eigen::Vector3d& ndc_point, std::size_t width, std::size_t height) {
+        return {(ndc_point(0) + 1.0) / 2.0 * width, (ndc_point(1) + 1.0) / 2.0 * height};
+    }
+
     // Check if a single point is within the NDC cube [-1, 1]^3
     inline bool within_ndc_cube(const Eigen::Vector3d& ndc_point) {
         return ndc_point(0) >= -1.0 && ndc_point(0) <= 1.0 &&
@@ -65,8 +233,42 @@ namespace rendering {
         return mask;
     }
 
+    // Facing of every face, a face is front facing when its vertexes are counter-clockwise in ndc space
+    std::vector<bool> compute_front_facing(const Eigen::Matrix3Xd& ndc_points, const models::ObjModel::FaceList& faces);
+
+    // Whether an edge survives culling, given the facing of the faces sharing it
+    inline bool edge_visible(const models::ObjModel::Edge& edge, const std::vector<bool>& front_facing, models::CullMode cull) {
+        bool front_0 = front_facing[edge.f0];
+        // A boundary edge only has f0 and is kept when f0 is: front facing under CULL_BACK and CULL_SILHOUETTE
+        // (an open border of a visible face is part of the outline), back facing under CULL_FRONT
+        bool front_1 = (edge.f1 == models::ObjModel::NO_FACE) ? false : front_facing[edge.f1];
+        bool back_1 = (edge.f1 == models::ObjModel::NO_FACE) ? false : !front_facing[edge.f1];
+
+        switch (cull) {
+            case models::CULL_BACK: return front_0 || front_1;
+            case models::CULL_FRONT: return !front_0 || back_1;
+            case models::CULL_SILHOUETTE: return front_0 != front_1;
+            default: return true;
+        }
+    }
+
+    // Whether a triangle survives culling in the shaded modes, given the z of the cross product of its ndc edges
+    inline bool shaded_face_visible(double ndc_cross_z, models::CullMode cull) {
+        if (cull == models::CULL_NONE)
+            return ndc_cross_z != 0;
+        if (cull == models::CULL_FRONT)
+            return ndc_cross_z < 0;
+        return ndc_cross_z > 0;
+    }
+
+    ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal, const models::Model& model,
+                        const std::vector<::scene::PointLight>& lights, const Eigen::Vector3d& eye_pos,
+                        const SpecularTable* specular_table);
+
+    // Same lighting model as lighting(), evaluated LIGHT_LANES lights at a time in single precision
     ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal, const models::Model& model,
-                        const std::vector<::scene::PointLight>& lights, const Eigen::Vector3d& eye_pos);
+                        const PackedLights& lights, const Eigen::Vector3d& eye_pos,
+                        const SpecularTable* specular_table);
 
 
     /* Draw the edges of the object on the image.
@@ -74,14 +276,36 @@ namespace rendering {
         @param ndc_points: the ndc points of the object
         @param faces: the surfaces of the object
         @param color: the color of the edges
+        @param line_mode: the line rasterizer to use
     */
     void draw_object_edges(ppm_image::PPMImage<float>& image, const models::Model& model, 
-        const scene::Camera& camera, ppm_image::Pixel<float> color = ppm_image::colors_f::WHITE);
+        const scene::Camera& camera, ppm_image::Pixel<float> color = ppm_image::colors_f::WHITE,
+        LineMode line_mode = BRESENHAM);
 
-    // Render the object on the image using the shader (phong or gouraud)
+    /* Draw a batch of edges on the image, every edge in the list is rasterized exactly once.
+        @param image: the image to draw on
+        @param ndc_points: the ndc points the edges index into, edges with both ends outside the ndc cube are skipped
+        @param faces: the faces the edges refer to, used to decide their facing
+        @param edges: the edges to draw, e.g. the cached ObjModel::edges
+        @param cull: which edges to skip, see edge_visible()
+        @param color: the color of the edges
+        @param line_mode: the line rasterizer to use
+    */
+    void draw_edges(ppm_image::PPMImage<float>& image, const Eigen::Matrix3Xd& ndc_points,
+        const models::ObjModel::FaceList& faces, const models::ObjModel::EdgeList& edges,
+        models::CullMode cull = models::CULL_NONE, ppm_image::Pixel<float> color = ppm_image::colors_f::WHITE,
+        LineMode line_mode = BRESENHAM);
+
+    // Render the object on the image using the shader (phong or gouraud), only the pixels inside scissor are touched
     void render_object(ppm_image::PPMImage<float>& image, const models::Model& model, 
-            const scene::Camera& camera, shader::Shader& shader, Eigen::MatrixXd& z_buffer);
-            
+            const scene::Camera& camera, shader::Shader& shader, Eigen::MatrixXd& z_buffer,
+            std::optional<ScreenRect> scissor = std::nullopt);
+
+    // Multisampled version: coverage and depth are tested per sample, but the shader runs only once per pixel
+    // (at the pixel center, or at the centroid of the covered samples when the center is outside the triangle)
+    void render_object(MultisampleBuffer& buffer, const models::Model& model,
+            const scene::Camera& camera, shader::Shader& shader, std::optional<ScreenRect> scissor = std::nullopt);
+
     // FillFunc should have the signature void(int x, int y, float alpha)
     template<typename FillFunc>
     void bresenham_draw_line(int x0, int y0, int x1, int y1, const FillFunc& fill) {
@@ -134,7 +358,66 @@ namespace rendering {
             }
         }
     }
-        
+
+    // Xiaolin Wu's line algorithm, pixel centers are at integer coordinates and the endpoints can be fractional.
+    // FillFunc should have the signature void(int x, int y, float alpha), alpha being the pixel coverage
+    template<typename FillFunc>
+    void wu_draw_line(double x0, double y0, double x1, double y1, const FillFunc& fill) {
+        auto fpart = [](double v) { return v - std::floor(v); };
+        auto rfpart = [&](double v) { return 1.0 - fpart(v); };
+
+        bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+        if (steep) {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+        if (x0 > x1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+
+        // Swap the axes back when filling, same as bresenham_draw_line()
+        auto plot = [&](int x, int y, double alpha) {
+            if (steep)
+                fill(y, x, static_cast<float>(alpha));
+            else
+                fill(x, y, static_cast<float>(alpha));
+        };
+
+        double dx = x1 - x0;
+        double dy = y1 - y0;
+        double gradient = (dx == 0.0) ? 1.0 : dy / dx;
+
+        // First endpoint
+        double x_end = std::round(x0);
+        double y_end = y0 + gradient * (x_end - x0);
+        double x_gap = rfpart(x0 + 0.5);
+        int x_start = static_cast<int>(x_end);
+        int y_start = static_cast<int>(std::floor(y_end));
+        plot(x_start, y_start, rfpart(y_end) * x_gap);
+        plot(x_start, y_start + 1, fpart(y_end) * x_gap);
+        double inter_y = y_end + gradient;
+
+        // Second endpoint
+        x_end = std::round(x1);
+        y_end = y1 + gradient * (x_end - x1);
+        x_gap = fpart(x1 + 0.5);
+        int x_stop = static_cast<int>(x_end);
+        int y_stop = static_cast<int>(std::floor(y_end));
+        if (x_stop != x_start) {
+            plot(x_stop, y_stop, rfpart(y_end) * x_gap);
+            plot(x_stop, y_stop + 1, fpart(y_end) * x_gap);
+        }
+
+        // Span between the endpoints, two pixels per column weighted by the distance to the ideal line
+        for (int x = x_start + 1; x < x_stop; x++) {
+            int y = static_cast<int>(std::floor(inter_y));
+            plot(x, y, rfpart(inter_y));
+            plot(x, y + 1, fpart(inter_y));
+            inter_y += gradient;
+        }
+    }
+
     // A test function to draw the only the dots of vertexes of the object
     void draw_object_dots(::ppm_image::PPMImage<uint8_t>& image, const Eigen::Matrix3Xd& ndc_points);
 
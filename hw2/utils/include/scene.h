@@ -6,13 +6,22 @@
 #include <memory>
 #include <iostream>
 #include <unordered_map>
+#include <map>
+#include <mutex>
 #include <filesystem>
+#include <limits>
+#include <cmath>
+#include <algorithm>
 #include <Eigen/Dense>
 
 #include "transformation.h"
 #include "models.h"
 #include "rendering.h"
 #include "shader.h"
+#include "shadow.h"
+#include "instance_bvh.h"
+#include "raytracer.h"
+#include "profiler.h"
 
 namespace scene {
 
@@ -42,9 +51,24 @@ inline Eigen::Matrix4d parse_transformation_line(std::istringstream& line) {
 }
 
 struct PointLight {
+    // Attenuation below which a light is treated as not contributing, half of one 8-bit color step
+    static constexpr double ATTENUATION_CUTOFF = 1.0 / 512.0;
+
     Eigen::Vector3d position;
     ppm_image::Pixel<float> color;
     double k;
+    // Distance at which the light, its brightest channel times the attenuation 1 / (1 + k d^2), drops below
+    // ATTENUATION_CUTOFF, infinite for k = 0
+    double influence_radius = std::numeric_limits<double>::infinity();
+    // Shadow map used as visibility term by lighting(), no shadows when empty
+    std::shared_ptr<const rendering::ShadowCubeMap> shadow;
+
+    // Call again after changing color or k
+    void update_influence_radius() {
+        const double brightest = std::max({color.r, color.g, color.b});
+        influence_radius = (k > 0) ? std::sqrt(std::max(0.0, brightest / ATTENUATION_CUTOFF - 1.0) / k)
+                                   : std::numeric_limits<double>::infinity();
+    }
 
     static std::optional<PointLight> parse_point_light_line(std::istringstream& line) {
         std::string field_name;
@@ -55,6 +79,7 @@ struct PointLight {
             line >> light.position.x() >> light.position.y() >> light.position.z() >> seperation;
             line >> light.color.r >> light.color.g >> light.color.b >> seperation;
             line >> light.k;
+            light.update_influence_radius();
             return light;
         }
         return std::nullopt;
@@ -138,6 +163,27 @@ struct Camera {
     }
 };
 
+// Color, depth and multisample storage of one frame
+struct FrameBuffers {
+    FrameBuffers(int width, int height, int samples = 1)
+        : image(height, width, 1), z_buffer(Eigen::MatrixXd::Ones(height, width)) {
+        if (samples > 1)
+            ms_buffer.emplace(height, width, samples);
+    }
+
+    // Black image and far depths, ready for the next frame
+    void clear() {
+        image.fill(ppm_image::colors_f::BLACK);
+        z_buffer.setOnes();
+        if (ms_buffer)
+            ms_buffer->clear();
+    }
+
+    ppm_image::PPMImage<float> image;
+    Eigen::MatrixXd z_buffer;
+    std::optional<rendering::MultisampleBuffer> ms_buffer;     // only for multisampled shaded modes
+};
+
 // Stroing all objects in the scene, and provide interface to organize and render the scene
 class SceneFile {
 public:
@@ -154,9 +200,15 @@ public:
     enum RenderMode {
         GOURAUD,
         PHONG,
-        EDGES
+        EDGES,
+        RAYTRACE        // raytracing::render(), hard shadows and mirror reflections with the same lighting()
     };
 
+    // Samples per pixel of the framebuffers a mode renders into, only the rasterized shaded modes multisample
+    static int buffer_samples(RenderMode mode, const rendering::RenderOptions& options) {
+        return (mode == GOURAUD || mode == PHONG) ? options.samples : 1;
+    }
+
     // Read the scene file and parse the camera and object information, parse the transformation matrix for each object
     SceneFile(const std::string& path): current_model(nullptr) {
         state = States::CAMERA;
@@ -243,37 +295,229 @@ public:
     // }
 
     // Rendering pipeline
-    ppm_image::PPMImage<float> render(int width, int height, RenderMode mode = GOURAUD) const {
+    ppm_image::PPMImage<float> render(int width, int height, RenderMode mode = GOURAUD,
+                                      const rendering::RenderOptions& options = rendering::RenderOptions()) const {
+        FrameBuffers buffers(width, height, buffer_samples(mode, options));
+        render_into(buffers, mode, options, camera);
+        return std::move(buffers.image);
+    }
 
-        ppm_image::PPMImage<float> result(height, width, 1);
-        Eigen::MatrixXd z_buffer = Eigen::MatrixXd::Ones(height, width);
-        
-        for (const auto& object : objects) {
+    // Render one frame from the given camera into buffers allocated by the caller, they are cleared first.
+    // Rendering many frames through the same buffers avoids reallocating them per frame.
+    void render_into(FrameBuffers& buffers, RenderMode mode, const rendering::RenderOptions& options,
+                     const Camera& view) const {
+        buffers.clear();
+
+        if (mode == RAYTRACE) {
+            raytracing::render(buffers.image, objects, lights, view, options, *ray_accel());
+            return;
+        }
+
+        // Shaded modes with more than one sample go through the multisample buffer and are resolved at the end
+        const bool multisample = mode != EDGES && options.samples > 1;
+        if (multisample && (!buffers.ms_buffer || buffers.ms_buffer->samples != options.samples))
+            buffers.ms_buffer.emplace(buffers.image.h(), buffers.image.w(), options.samples);
+
+        draw_objects(buffers, mode, options, view, std::nullopt);
+
+        if (multisample) {
+            profiler::ScopedTimer timer(profiler::RESOLVE);
+            buffers.ms_buffer->resolve(buffers.image);
+        }
+    }
+
+    /* Rasterize the objects into buffers without clearing or resolving them, for the rasterized modes only
+        @param scissor: only touch the pixels in this rectangle and skip the objects whose screen_bounds() miss it,
+            the whole image when empty
+    */
+    void draw_objects(FrameBuffers& buffers, RenderMode mode, const rendering::RenderOptions& options,
+                      const Camera& view, std::optional<rendering::ScreenRect> scissor) const {
+        ppm_image::PPMImage<float>& result = buffers.image;
+        Eigen::MatrixXd& z_buffer = buffers.z_buffer;
+        const bool multisample = mode != EDGES && options.samples > 1;
+        std::optional<rendering::MultisampleBuffer>& ms_buffer = buffers.ms_buffer;
+
+        auto draw = [&](const models::Model& object, shader::Shader& shader) {
+            if (multisample)
+                rendering::render_object(*ms_buffer, object, view, shader, scissor);
+            else
+                rendering::render_object(result, object, view, shader, z_buffer, scissor);
+        };
+
+        // Lights of this frame, with their shadow maps attached when shadows are enabled
+        std::vector<PointLight> frame_lights = lights;
+        if (options.shadows && mode != EDGES)
+            attach_shadow_maps(frame_lights, options.shadow_resolution);
+
+        // Specular tables are built once per shininess value and shared by the objects using it
+        std::map<float, rendering::SpecularTable> specular_tables;
+        auto specular_table_for = [&](const models::Model& object) -> const rendering::SpecularTable* {
+            if (options.specular_mode != rendering::SPECULAR_TABLE)
+                return nullptr;
+            auto it = specular_tables.try_emplace(object.shininess, object.shininess).first;
+            return &it->second;
+        };
+
+        // Only the instances in the view frustum are drawn, nearest first so the depth test rejects more fragments
+        std::vector<std::size_t> visible;
+        {
+            profiler::ScopedTimer timer(profiler::CULLING);
+            Frustum frustum(view.get_perspective_projection_matrix() * view.get_transformation().inverse());
+            visible = instance_bvh()->visible(frustum, view.position);
+            profiler::count(profiler::INSTANCES_CULLED, objects.size() - visible.size());
+        }
+
+        for (std::size_t i : visible) {
+            const models::Model& object = objects[i];
             // std::cout << "ndc_points_3d: " << ndc_points_3d << std::endl;
             // std::cout << object.transform << std::endl;
+            if (scissor && !rendering::screen_bounds(object, view, result.w(), result.h()).intersects(*scissor))
+                continue;
+
             // Render based on mode
             if (mode == EDGES) {
-                rendering::draw_object_edges(result, object, camera);
-            } else if (mode == GOURAUD) {
-                shader::Gouraud gouraud_shader(const_cast<models::Model&>(object), 
-                            const_cast<std::vector<PointLight>&>(lights), camera.position);
-                rendering::render_object(result, object, camera, gouraud_shader, z_buffer);
+                rendering::draw_object_edges(result, object, view, ppm_image::colors_f::WHITE, options.line_mode);
+                continue;
+            }
+
+            // Only the lights that can reach the object are passed down to the shader
+            std::vector<PointLight> object_lights = lights_reaching(object, frame_lights);
+            std::optional<rendering::PackedLights> packed_lights;
+            if (options.packed_lights)
+                packed_lights.emplace(object_lights);
+
+            if (mode == GOURAUD) {
+                shader::Gouraud gouraud_shader(const_cast<models::Model&>(object), object_lights, view.position);
+                gouraud_shader.set_packed_lights(packed_lights ? &*packed_lights : nullptr);
+                gouraud_shader.set_specular_table(specular_table_for(object));
+                draw(object, gouraud_shader);
             } else if (mode == PHONG) {
-                shader::Phong phong_shader(const_cast<models::Model&>(object), 
-                            const_cast<std::vector<PointLight>&>(lights), camera.position);
-                rendering::render_object(result, object, camera, phong_shader, z_buffer);
+                shader::Phong phong_shader(const_cast<models::Model&>(object), object_lights, view.position);
+                phong_shader.set_packed_lights(packed_lights ? &*packed_lights : nullptr);
+                phong_shader.set_specular_table(specular_table_for(object));
+                draw(object, phong_shader);
             }
         }
-        
+    }
+
+    // Bin the lights for one object: keep the lights whose influence sphere overlaps the bounding sphere of the object
+    std::vector<PointLight> lights_reaching(const models::Model& object, const std::vector<PointLight>& candidates) const {
+        auto [center, radius] = object.bounding_sphere();
+        std::vector<PointLight> result;
+        for (const auto& light : candidates) {
+            if ((light.position - center).norm() <= light.influence_radius + radius)
+                result.push_back(light);
+        }
         return result;
     }
 
+    // Hierarchy over the world bounds of the objects, rebuilt when an object was added, moved or given another mesh
+    // since the last call
+    std::shared_ptr<const InstanceBVH> instance_bvh() const {
+        std::lock_guard<std::mutex> lock(bvh_mutex);
+        const std::size_t fingerprint = geometry_fingerprint();
+        if (!bvh || bvh_fingerprint != fingerprint) {
+            bvh = std::make_shared<const InstanceBVH>(objects);
+            bvh_fingerprint = fingerprint;
+        }
+        return bvh;
+    }
+
+    // Ray tracing hierarchies of the objects, rebuilt when the geometry changed since the last call. The mesh
+    // hierarchies of the previous build are kept, only moving objects just rebuilds the instance level.
+    std::shared_ptr<const raytracing::SceneAccel> ray_accel() const {
+        std::lock_guard<std::mutex> lock(accel_mutex);
+        const std::size_t fingerprint = geometry_fingerprint();
+        if (!accel || accel_fingerprint != fingerprint) {
+            profiler::ScopedTimer timer(profiler::ACCEL_BUILD);
+            accel = std::make_shared<const raytracing::SceneAccel>(objects, accel.get());
+            accel_fingerprint = fingerprint;
+        }
+        return accel;
+    }
+
+    // Give every light its shadow map. Maps are reused from the previous render() when the light, the resolution
+    // and the geometry are unchanged, otherwise one depth pass per light rebuilds them.
+    void attach_shadow_maps(std::vector<PointLight>& frame_lights, int resolution) const {
+        // Frames rendered in parallel share the cache, the first one to need a map builds it
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        const std::size_t geometry = geometry_fingerprint();
+        shadow_cache.resize(frame_lights.size());
+
+        for (std::size_t i = 0; i < frame_lights.size(); i++) {
+            PointLight& light = frame_lights[i];
+            std::size_t fingerprint = geometry;
+            hash_combine(fingerprint, light.position.x());
+            hash_combine(fingerprint, light.position.y());
+            hash_combine(fingerprint, light.position.z());
+            hash_combine(fingerprint, light.influence_radius);
+            hash_combine(fingerprint, resolution);
+
+            ShadowCacheEntry& entry = shadow_cache[i];
+            if (!entry.map || entry.fingerprint != fingerprint) {
+                // The far plane reaches the furthest object, or the end of the light influence if that is closer
+                double far = 0.0;
+                for (const auto& object : objects) {
+                    auto [center, radius] = object.bounding_sphere();
+                    far = std::max(far, (center - light.position).norm() + radius);
+                }
+                far = std::min(far, light.influence_radius);
+                double near = std::max(far * 1e-3, 1e-6);
+
+                // The depth passes count as shadow map time only, not as rasterizer stages of the frame
+                profiler::ScopedTimer timer(profiler::SHADOW_MAPS);
+                auto map = std::make_shared<rendering::ShadowCubeMap>(light.position, near, far, resolution);
+                {
+                    profiler::Session depth_passes(nullptr);
+                    map->render(objects);
+                }
+                entry.map = map;
+                entry.fingerprint = fingerprint;
+            }
+            light.shadow = entry.map;
+        }
+    }
+
     Camera camera;
     std::vector<models::Model> objects;
     std::string scene_path;
     std::vector<PointLight> lights;
 
 private:
+    struct ShadowCacheEntry {
+        std::size_t fingerprint = 0;
+        std::shared_ptr<const rendering::ShadowCubeMap> map;
+    };
+    // Shadow maps of the previous render() call, indexed like lights
+    mutable std::vector<ShadowCacheEntry> shadow_cache;
+    mutable std::mutex shadow_mutex;
+    // Instance hierarchy of the last instance_bvh() call and the geometry it was built from
+    mutable std::shared_ptr<const InstanceBVH> bvh;
+    mutable std::size_t bvh_fingerprint = 0;
+    mutable std::mutex bvh_mutex;
+    // Same for the ray tracing hierarchies
+    mutable std::shared_ptr<const raytracing::SceneAccel> accel;
+    mutable std::size_t accel_fingerprint = 0;
+    mutable std::mutex accel_mutex;
+
+    template <typename T>
+    static void hash_combine(std::size_t& seed, const T& value) {
+        seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    // Hash of everything the depth passes and the hierarchies depend on: the meshes, the transforms and the
+    // culling of every object
+    std::size_t geometry_fingerprint() const {
+        std::size_t seed = objects.size();
+        for (const auto& object : objects) {
+            hash_combine(seed, object.obj_file.get());
+            hash_combine(seed, static_cast<int>(object.cull));
+            for (int i = 0; i < 16; i++)
+                hash_combine(seed, object.transform(i));
+        }
+        return seed;
+    }
+
     States state;
     std::unordered_map<std::string, std::pair<std::shared_ptr<models::ObjModel>, int>> object_files;
     // std::string current_label;
@@ -10,9 +10,14 @@ namespace scene {
     struct PointLight;
 }
 namespace rendering {
+    struct PackedLights;
+    struct SpecularTable;
     ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal, 
                                    const models::Model& model, const std::vector<scene::PointLight>& lights, 
-                                   const Eigen::Vector3d& eye_pos);
+                                   const Eigen::Vector3d& eye_pos, const SpecularTable* specular_table);
+    ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal,
+                                   const models::Model& model, const PackedLights& lights,
+                                   const Eigen::Vector3d& eye_pos, const SpecularTable* specular_table);
 }
 
 namespace shader {
@@ -25,10 +30,29 @@ public:
     virtual void new_triangle(const Eigen::Vector3d& va, const Eigen::Vector3d& vb, const Eigen::Vector3d& vc, 
         const Eigen::Vector3d& na, const Eigen::Vector3d& nb, const Eigen::Vector3d& nc) = 0;
 
+    // Use the packed lights for lighting instead of the light vector, pass nullptr to go back
+    void set_packed_lights(const rendering::PackedLights* packed) {
+        packed_lights = packed;
+    }
+
+    // Evaluate the specular power with a lookup table instead of std::pow, pass nullptr to go back
+    void set_specular_table(const rendering::SpecularTable* table) {
+        specular_table = table;
+    }
+
 protected:
     models::Model& model;
     std::vector<scene::PointLight>& lights;
     Eigen::Vector3d eye_pos;
+    const rendering::PackedLights* packed_lights = nullptr;
+    const rendering::SpecularTable* specular_table = nullptr;
+
+    // Evaluate the lighting at a point with whichever light representation is active
+    ppm_image::Pixel<float> light_at(const Eigen::Vector3d& P, const Eigen::Vector3d& normal) const {
+        if (packed_lights)
+            return rendering::lighting(P, normal, model, *packed_lights, eye_pos, specular_table);
+        return rendering::lighting(P, normal, model, lights, eye_pos, specular_table);
+    }
 };
 
 
@@ -43,9 +67,9 @@ public:
 
     void new_triangle(const Eigen::Vector3d& va, const Eigen::Vector3d& vb, const Eigen::Vector3d& vc, 
         const Eigen::Vector3d& na, const Eigen::Vector3d& nb, const Eigen::Vector3d& nc) override {
-            color_a = rendering::lighting(va, na, model, lights, eye_pos);
-            color_b = rendering::lighting(vb, nb, model, lights, eye_pos);
-            color_c = rendering::lighting(vc, nc, model, lights, eye_pos);
+            color_a = light_at(va, na);
+            color_b = light_at(vb, nb);
+            color_c = light_at(vc, nc);
     }
 
 protected:
@@ -74,7 +98,7 @@ public:
     ppm_image::Pixel<float> compute_color(float alpha, float beta, float gamma) override {
         Eigen::Vector3d normal = (alpha * na + beta * nb + gamma * nc).normalized();
         Eigen::Vector3d vertex = alpha * va + beta * vb + gamma * vc;
-        return rendering::lighting(vertex, normal, model, lights, eye_pos);
+        return light_at(vertex, normal);
     }
 
 protected:
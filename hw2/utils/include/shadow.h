@@ -0,0 +1,50 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <array>
+#include <vector>
+#include <Eigen/Dense>
+#include "models.h"
+
+
+namespace rendering {
+
+    // Omnidirectional shadow map of one point light: six 90 degree depth buffers around the light, one per cube face.
+    // The depths are rasterized with render_object() and stored as linear distances along the face axis.
+    struct ShadowCubeMap {
+        static constexpr int FACES = 6;
+        // Half width of the percentage closer filter, 1 gives a 3x3 kernel
+        static constexpr int PCF_RADIUS = 1;
+
+        /* @param position: position of the light
+            @param near: near plane of the cube faces
+            @param far: far plane of the cube faces, points further away than it are always lit
+            @param resolution: width and height of each face in texels
+        */
+        ShadowCubeMap(const Eigen::Vector3d& position, double near, double far, int resolution);
+
+        // Rasterize the depth of all objects into the six faces
+        void render(const std::vector<models::Model>& objects);
+
+        // Fraction of the 3x3 texels around P that see the light, 1 is fully lit and 0 fully shadowed
+        double visibility(const Eigen::Vector3d& P, const Eigen::Vector3d& normal) const;
+
+        // Cube face that the direction from the light falls into, ordered +x, -x, +y, -y, +z, -z
+        static int face_of(const Eigen::Vector3d& direction);
+
+        Eigen::Vector3d position;
+        double near;
+        double far;
+        int resolution;
+        std::array<Eigen::Matrix4d, FACES> T_ndc;         // world to ndc of each face
+        std::array<Eigen::MatrixXd, FACES> depths;        // linear depth per texel, indexed (y, x) like the z buffer
+
+    private:
+        double linear_depth(double ndc_z) const {
+            return 2.0 * far * near / ((far + near) - ndc_z * (far - near));
+        }
+    };
+
+} // namespace rendering
+
+#endif // SHADOW_H
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include "incremental.h"
+#include "profiler.h"
+
+namespace scene {
+
+namespace {
+
+bool same_camera(const Camera& a, const Camera& b) {
+    return a.position == b.position && a.orientation == b.orientation &&
+           a.n == b.n && a.f == b.f && a.l == b.l && a.r == b.r && a.t == b.t && a.b == b.b;
+}
+
+bool same_pixel(const ppm_image::Pixel<float>& a, const ppm_image::Pixel<float>& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// Merge overlapping rectangles until none overlap, so no pixel is redrawn twice
+std::vector<rendering::ScreenRect> merge_overlapping(std::vector<rendering::ScreenRect> rects) {
+    rects.erase(std::remove_if(rects.begin(), rects.end(), [](const rendering::ScreenRect& r) { return r.empty(); }), rects.end());
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (std::size_t i = 0; i < rects.size() && !merged; i++) {
+            for (std::size_t j = i + 1; j < rects.size(); j++) {
+                if (rects[i].intersects(rects[j])) {
+                    rects[i] = rects[i].united(rects[j]);
+                    rects.erase(rects.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+    return rects;
+}
+
+} // namespace
+
+
+IncrementalRenderer::IncrementalRenderer(const SceneFile& scene, int width, int height, SceneFile::RenderMode mode,
+                                         const rendering::RenderOptions& options)
+    : scene(scene), mode(mode), options(options), buffers(width, height, SceneFile::buffer_samples(mode, options)) {}
+
+IncrementalRenderer::ObjectState IncrementalRenderer::capture(const models::Model& object) const {
+    return {object.obj_file.get(), object.transform, object.ambient, object.diffuse, object.specular,
+            object.shininess, object.cull,
+            rendering::screen_bounds(object, scene.camera, buffers.image.w(), buffers.image.h())};
+}
+
+bool IncrementalRenderer::same_geometry(const ObjectState& a, const ObjectState& b) const {
+    return a.obj_file == b.obj_file && a.transform == b.transform && a.cull == b.cull;
+}
+
+bool IncrementalRenderer::same_material(const ObjectState& a, const ObjectState& b) const {
+    return same_pixel(a.ambient, b.ambient) && same_pixel(a.diffuse, b.diffuse) &&
+           same_pixel(a.specular, b.specular) && a.shininess == b.shininess;
+}
+
+bool IncrementalRenderer::same_lights() const {
+    if (scene.lights.size() != last_lights.size())
+        return false;
+    for (std::size_t i = 0; i < last_lights.size(); i++) {
+        const PointLight& a = scene.lights[i];
+        const PointLight& b = last_lights[i];
+        if (a.position != b.position || !same_pixel(a.color, b.color) || a.k != b.k)
+            return false;
+    }
+    return true;
+}
+
+void IncrementalRenderer::full_render() {
+    scene.render_into(buffers, mode, options, scene.camera);
+    rendered = true;
+    last_camera = scene.camera;
+    last_lights = scene.lights;
+    last_objects.clear();
+    for (const auto& object : scene.objects)
+        last_objects.push_back(capture(object));
+    last_dirty = {rendering::ScreenRect::full(buffers.image.w(), buffers.image.h())};
+}
+
+const ppm_image::PPMImage<float>& IncrementalRenderer::update() {
+    if (!rendered || mode == SceneFile::EDGES || mode == SceneFile::RAYTRACE || !same_camera(scene.camera, last_camera) || !same_lights() ||
+        scene.objects.size() != last_objects.size()) {
+        full_render();
+        return buffers.image;
+    }
+
+    // Old and new bounds of every changed object
+    std::vector<ObjectState> current;
+    std::vector<rendering::ScreenRect> dirty;
+    bool moved = false;
+    for (std::size_t i = 0; i < scene.objects.size(); i++) {
+        current.push_back(capture(scene.objects[i]));
+        const ObjectState& before = last_objects[i];
+        const ObjectState& now = current.back();
+        if (!same_geometry(before, now)) {
+            moved = true;
+            dirty.push_back(before.bounds.united(now.bounds));
+        } else if (!same_material(before, now)) {
+            dirty.push_back(now.bounds);
+        }
+    }
+    if (moved && options.shadows) {
+        full_render();
+        return buffers.image;
+    }
+
+    last_objects = std::move(current);
+    last_dirty = merge_overlapping(dirty);
+    for (const auto& rect : last_dirty) {
+        for (int y = rect.ymin; y <= rect.ymax; y++)
+            for (int x = rect.xmin; x <= rect.xmax; x++)
+                buffers.image[y][x] = ppm_image::colors_f::BLACK;
+        buffers.z_buffer.block(rect.ymin, rect.xmin, rect.ymax - rect.ymin + 1, rect.xmax - rect.xmin + 1).setOnes();
+        if (buffers.ms_buffer)
+            buffers.ms_buffer->clear(rect);
+
+        scene.draw_objects(buffers, mode, options, scene.camera, rect);
+
+        if (buffers.ms_buffer) {
+            profiler::ScopedTimer timer(profiler::RESOLVE);
+            buffers.ms_buffer->resolve(buffers.image, rect);
+        }
+    }
+    return buffers.image;
+}
+
+} // namespace scene
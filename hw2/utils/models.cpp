@@ -2,6 +2,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 #include <Eigen/Dense>
 
 
@@ -11,6 +14,7 @@ bool ObjModel::load_from_obj_file(const std::string& filename) {
     this->filename = filename;
     vertexes.clear();
     faces.clear();
+    edges.clear();
     
     std::ifstream file(filename);
     if (!file.is_open()) {
@@ -81,8 +85,47 @@ bool ObjModel::load_from_obj_file(const std::string& filename) {
         }
         // Lines not starting with 'v' or 'f' followed by space are ignored
     }
+
+    // Shared edges are deduplicated once here so that wireframe rendering draws each edge only once
+    edges = compute_unique_edges(faces);
+
+    if (!vertexes.empty()) {
+        bound_min = vertexes.front();
+        bound_max = vertexes.front();
+        for (const auto& vertex : vertexes) {
+            bound_min = bound_min.cwiseMin(vertex);
+            bound_max = bound_max.cwiseMax(vertex);
+        }
+    }
+
+    // Every instance transforms the same object space matrices, they are exported once here
+    vertexes_homo = export_vertexes_matrix_homo();
+    normals_matrix = export_normals_matrix();
     
     return true;
 }
 
+ObjModel::EdgeList ObjModel::compute_unique_edges(const FaceList& faces) {
+    EdgeList edges;
+    edges.reserve(faces.size() * 3 / 2);
+
+    // Key each edge by its sorted vertex pair so both winding directions map to the same entry
+    std::unordered_map<std::uint64_t, std::size_t> edge_index;
+    edge_index.reserve(faces.size() * 3 / 2);
+    for (std::size_t f = 0; f < faces.size(); f++) {
+        const auto& face = faces[f];
+        for (int i = 0; i < 3; i++) {
+            std::size_t v0 = std::min(face[i], face[(i+1)%3]);
+            std::size_t v1 = std::max(face[i], face[(i+1)%3]);
+            std::uint64_t key = (static_cast<std::uint64_t>(v0) << 32) | static_cast<std::uint64_t>(v1);
+            auto [it, inserted] = edge_index.emplace(key, edges.size());
+            if (inserted)
+                edges.push_back(Edge{v0, v1, f, NO_FACE});
+            else if (edges[it->second].f1 == NO_FACE)
+                edges[it->second].f1 = f;
+        }
+    }
+    return edges;
+}
+
 } // namespace models
\ No newline at end of file
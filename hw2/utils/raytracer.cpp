@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <Eigen/Dense>
+#include "raytracer.h"
+#include "scene.h"
+#include "profiler.h"
+
+namespace raytracing {
+
+namespace {
+
+using Lanes = RayPacket::Lanes;
+using Mask = RayPacket::Mask;
+
+// Deepest stack a traversal can need, one entry per level below the root plus the root
+constexpr int STACK_SIZE = BVH::MAX_DEPTH + 1;
+
+// Distance a secondary ray starts off the surface, relative to the magnitude of the hit point coordinates
+constexpr double RAY_OFFSET = 1e-7;
+
+// A packet moved into the object space of an instance, with the reciprocal directions for the slab tests
+struct LocalPacket {
+    Lanes ox, oy, oz;
+    Lanes dx, dy, dz;
+    Lanes idx, idy, idz;
+
+    LocalPacket(const RayPacket& packet, const Eigen::Matrix4d& m) {
+        ox = m(0, 0) * packet.ox + m(0, 1) * packet.oy + m(0, 2) * packet.oz + m(0, 3);
+        oy = m(1, 0) * packet.ox + m(1, 1) * packet.oy + m(1, 2) * packet.oz + m(1, 3);
+        oz = m(2, 0) * packet.ox + m(2, 1) * packet.oy + m(2, 2) * packet.oz + m(2, 3);
+        dx = m(0, 0) * packet.dx + m(0, 1) * packet.dy + m(0, 2) * packet.dz;
+        dy = m(1, 0) * packet.dx + m(1, 1) * packet.dy + m(1, 2) * packet.dz;
+        dz = m(2, 0) * packet.dx + m(2, 1) * packet.dy + m(2, 2) * packet.dz;
+        set_inverse();
+    }
+
+    explicit LocalPacket(const RayPacket& packet)
+        : ox(packet.ox), oy(packet.oy), oz(packet.oz), dx(packet.dx), dy(packet.dy), dz(packet.dz) {
+        set_inverse();
+    }
+
+    void set_inverse() {
+        idx = dx.inverse();
+        idy = dy.inverse();
+        idz = dz.inverse();
+    }
+
+    // Lanes whose ray passes through the box within [t_min, t_max]
+    Mask hits(const scene::AABB& box, const Lanes& t_min, const Lanes& t_max) const {
+        Lanes x0 = (box.min.x() - ox) * idx, x1 = (box.max.x() - ox) * idx;
+        Lanes y0 = (box.min.y() - oy) * idy, y1 = (box.max.y() - oy) * idy;
+        Lanes z0 = (box.min.z() - oz) * idz, z1 = (box.max.z() - oz) * idz;
+        Lanes t_enter = x0.min(x1).max(y0.min(y1)).max(z0.min(z1)).max(t_min);
+        Lanes t_exit = x0.max(x1).min(y0.max(y1)).min(z0.max(z1)).min(t_max);
+        return t_enter <= t_exit;
+    }
+
+    // Moller-Trumbore test of one triangle against all lanes, u and v are the barycentric coordinates of v0 + e1
+    // and v0 + e2
+    Mask intersect(const Eigen::Vector3d& v0, const Eigen::Vector3d& e1, const Eigen::Vector3d& e2,
+                   const Lanes& t_min, const Lanes& t_max, Lanes& t, Lanes& u, Lanes& v) const {
+        Lanes px = dy * e2.z() - dz * e2.y();
+        Lanes py = dz * e2.x() - dx * e2.z();
+        Lanes pz = dx * e2.y() - dy * e2.x();
+        Lanes inv_det = (e1.x() * px + e1.y() * py + e1.z() * pz).inverse();
+        Lanes sx = ox - v0.x(), sy = oy - v0.y(), sz = oz - v0.z();
+        u = (sx * px + sy * py + sz * pz) * inv_det;
+        Lanes qx = sy * e1.z() - sz * e1.y();
+        Lanes qy = sz * e1.x() - sx * e1.z();
+        Lanes qz = sx * e1.y() - sy * e1.x();
+        v = (dx * qx + dy * qy + dz * qz) * inv_det;
+        t = (e2.x() * qx + e2.y() * qy + e2.z() * qz) * inv_det;
+        // A parallel ray gives an infinite inv_det and NaN coordinates, which fail every comparison
+        return u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t >= t_min && t < t_max;
+    }
+};
+
+// Index of the first active lane, its direction decides which child is visited first
+int first_lane(const Mask& mask) {
+    for (int l = 0; l < RayPacket::SIZE; l++) {
+        if (mask(l))
+            return l;
+    }
+    return 0;
+}
+
+template <typename Visit>
+void traverse_bvh(const BVH& bvh, const LocalPacket& local, const Lanes& t_min, const Lanes& t_max,
+                  const Mask& active, const Visit& visit) {
+    if (bvh.nodes.empty())
+        return;
+    const int lane = first_lane(active);
+    const Lanes* direction[3] = {&local.dx, &local.dy, &local.dz};
+
+    std::uint32_t stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const std::uint32_t index = stack[--size];
+        const BVH::Node& node = bvh.nodes[index];
+        if (!(local.hits(node.bounds, t_min, t_max) && active).any())
+            continue;
+        if (node.count > 0) {
+            // visit returns false once no lane needs more work
+            if (!visit(node.first, node.first + node.count))
+                return;
+            continue;
+        }
+        // Push the far child first so the near one is visited next
+        if ((*direction[node.axis])(lane) >= 0) {
+            stack[size++] = node.first;
+            stack[size++] = index + 1;
+        } else {
+            stack[size++] = index + 1;
+            stack[size++] = node.first;
+        }
+    }
+}
+
+// Colors of the lanes of one packet
+using PacketColors = std::array<ppm_image::Pixel<float>, RayPacket::SIZE>;
+
+// Shading state shared by the tracing threads
+struct Tracer {
+    const std::vector<models::Model>& objects;
+    const std::vector<scene::PointLight>& lights;
+    const rendering::RenderOptions& options;
+    const SceneAccel& accel;
+    std::map<float, rendering::SpecularTable> specular_tables;
+
+    const rendering::SpecularTable* specular_table_for(const models::Model& object) const {
+        auto it = specular_tables.find(object.shininess);
+        return it != specular_tables.end() ? &it->second : nullptr;
+    }
+
+    PacketColors trace(const RayPacket& packet, int depth) const {
+        PacketColors colors{};
+        profiler::count(profiler::RAYS, packet.active.count());
+        PacketHit hit;
+        {
+            profiler::ScopedTimer timer(profiler::RAY_TRAVERSAL);
+            hit = accel.intersect(packet);
+        }
+        if (!hit.hit.any())
+            return colors;
+
+        // Hit points, shading normals interpolated like the Phong shader, and geometric normals facing the ray
+        std::array<Eigen::Vector3d, RayPacket::SIZE> P, N, G, D;
+        for (int l = 0; l < RayPacket::SIZE; l++) {
+            if (!hit.hit(l))
+                continue;
+            const models::Model& object = objects[hit.object[l]];
+            const models::ObjModel& obj = *object.obj_file;
+            const models::ObjModel::Face& face = obj.faces[hit.face[l]];
+            const Eigen::Matrix3d linear = object.transform.block<3,3>(0,0);
+            const double u = hit.u(l), v = hit.v(l), w = 1.0 - u - v;
+
+            D[l] = Eigen::Vector3d(packet.dx(l), packet.dy(l), packet.dz(l)).normalized();
+            P[l] = Eigen::Vector3d(packet.ox(l), packet.oy(l), packet.oz(l)) + hit.t(l) * Eigen::Vector3d(packet.dx(l), packet.dy(l), packet.dz(l));
+            N[l] = (w * (linear * obj.normals[face[3]]).normalized() + u * (linear * obj.normals[face[4]]).normalized() +
+                    v * (linear * obj.normals[face[5]]).normalized()).normalized();
+            Eigen::Vector3d object_normal = (obj.vertexes[face[1]] - obj.vertexes[face[0]]).cross(obj.vertexes[face[2]] - obj.vertexes[face[0]]);
+            G[l] = (linear.inverse().transpose() * object_normal).normalized();
+            if (G[l].dot(D[l]) > 0)
+                G[l] = -G[l];
+        }
+        auto offset_point = [&](int l) {
+            return P[l] + G[l] * RAY_OFFSET * (1.0 + P[l].cwiseAbs().maxCoeff());
+        };
+
+        // One shadow packet per light, lanes out of the light's reach do not need a ray
+        std::array<std::vector<scene::PointLight>, RayPacket::SIZE> visible_lights;
+        for (const auto& light : lights) {
+            RayPacket shadow;
+            for (int l = 0; l < RayPacket::SIZE; l++) {
+                shadow.active(l) = hit.hit(l) && (light.position - P[l]).squaredNorm() <= light.influence_radius * light.influence_radius;
+                if (!shadow.active(l))
+                    continue;
+                Eigen::Vector3d origin = offset_point(l);
+                Eigen::Vector3d to_light = light.position - origin;
+                shadow.ox(l) = origin.x(); shadow.oy(l) = origin.y(); shadow.oz(l) = origin.z();
+                shadow.dx(l) = to_light.x(); shadow.dy(l) = to_light.y(); shadow.dz(l) = to_light.z();
+                shadow.t_min(l) = 0.0;
+                shadow.t_max(l) = 1.0;
+            }
+            if (!shadow.active.any())
+                continue;
+            profiler::count(profiler::RAYS, shadow.active.count());
+            Mask occluded;
+            {
+                profiler::ScopedTimer timer(profiler::RAY_TRAVERSAL);
+                occluded = accel.occluded(shadow);
+            }
+            for (int l = 0; l < RayPacket::SIZE; l++) {
+                if (shadow.active(l) && !occluded(l))
+                    visible_lights[l].push_back(light);
+            }
+        }
+
+        {
+            profiler::ScopedTimer timer(profiler::SHADING);
+            for (int l = 0; l < RayPacket::SIZE; l++) {
+                if (!hit.hit(l))
+                    continue;
+                const models::Model& object = objects[hit.object[l]];
+                Eigen::Vector3d eye(packet.ox(l), packet.oy(l), packet.oz(l));
+                colors[l] = rendering::lighting(P[l], N[l], object, visible_lights[l], eye, specular_table_for(object));
+            }
+        }
+
+        if (depth >= options.reflection_depth)
+            return colors;
+
+        // Mirror rays of the reflective lanes, traced together as the next packet
+        RayPacket mirror;
+        for (int l = 0; l < RayPacket::SIZE; l++) {
+            const ppm_image::Pixel<float>* reflectivity = hit.hit(l) ? &objects[hit.object[l]].reflectivity : nullptr;
+            mirror.active(l) = reflectivity && (reflectivity->r > 0 || reflectivity->g > 0 || reflectivity->b > 0);
+            if (!mirror.active(l))
+                continue;
+            Eigen::Vector3d origin = offset_point(l);
+            Eigen::Vector3d direction = D[l] - 2.0 * D[l].dot(N[l]) * N[l];
+            mirror.ox(l) = origin.x(); mirror.oy(l) = origin.y(); mirror.oz(l) = origin.z();
+            mirror.dx(l) = direction.x(); mirror.dy(l) = direction.y(); mirror.dz(l) = direction.z();
+            mirror.t_min(l) = 0.0;
+            mirror.t_max(l) = std::numeric_limits<double>::infinity();
+        }
+        if (!mirror.active.any())
+            return colors;
+
+        PacketColors reflected = trace(mirror, depth + 1);
+        for (int l = 0; l < RayPacket::SIZE; l++) {
+            if (!mirror.active(l))
+                continue;
+            const ppm_image::Pixel<float>& k = objects[hit.object[l]].reflectivity;
+            colors[l].r += k.r * reflected[l].r;
+            colors[l].g += k.g * reflected[l].g;
+            colors[l].b += k.b * reflected[l].b;
+            colors[l].clamp(1.0);
+        }
+        return colors;
+    }
+};
+
+} // namespace
+
+
+BVH::BVH(const std::vector<scene::AABB>& boxes) {
+    if (boxes.empty())
+        return;
+    std::vector<Eigen::Vector3d> centers;
+    centers.reserve(boxes.size());
+    for (const auto& box : boxes)
+        centers.push_back(box.center());
+    order.resize(boxes.size());
+    std::iota(order.begin(), order.end(), 0);
+    nodes.reserve(2 * boxes.size());
+    build(0, boxes.size(), boxes, centers, 0);
+}
+
+std::size_t BVH::build(std::size_t begin, std::size_t end, const std::vector<scene::AABB>& boxes,
+                       const std::vector<Eigen::Vector3d>& centers, int depth) {
+    const std::size_t index = nodes.size();
+    nodes.emplace_back();
+    scene::AABB bounds, center_bounds;
+    for (std::size_t i = begin; i < end; i++) {
+        bounds.expand(boxes[order[i]]);
+        center_bounds.expand(centers[order[i]]);
+    }
+    nodes[index].bounds = bounds;
+    const std::size_t count = end - begin;
+
+    auto make_leaf = [&]() {
+        nodes[index].first = static_cast<std::uint32_t>(begin);
+        nodes[index].count = static_cast<std::uint32_t>(count);
+        return index;
+    };
+    if (count == 1 || depth == MAX_DEPTH)
+        return make_leaf();
+
+    auto split = [&](std::size_t middle) {
+        build(begin, middle, boxes, centers, depth + 1);
+        const std::size_t second = build(middle, end, boxes, centers, depth + 1);
+        nodes[index].first = static_cast<std::uint32_t>(second);
+        return index;
+    };
+
+    // Deep in the tree, e.g. after many lopsided splits of a degenerate mesh, halve along the widest axis so the
+    // levels left below MAX_DEPTH are always enough
+    if (depth >= MAX_DEPTH / 2) {
+        if (count <= MAX_LEAF_SIZE)
+            return make_leaf();
+        int axis = 0;
+        for (int a = 1; a < 3; a++) {
+            if (center_bounds.max(a) - center_bounds.min(a) > center_bounds.max(axis) - center_bounds.min(axis))
+                axis = a;
+        }
+        const std::size_t middle = begin + count / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](std::size_t a, std::size_t b) { return centers[a](axis) < centers[b](axis); });
+        nodes[index].axis = axis;
+        return split(middle);
+    }
+
+    // Cost of every plane between two bins on every axis: traversal plus the primitives on each side weighted by
+    // the chance that a ray through the node also passes through that side, the ratio of surface areas
+    const double parent_area = std::max(bounds.surface_area(), std::numeric_limits<double>::min());
+    double best_cost = std::numeric_limits<double>::infinity();
+    int best_axis = -1, best_plane = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        const double extent = center_bounds.max(axis) - center_bounds.min(axis);
+        if (extent <= 0)
+            continue;
+        const double scale = BINS / extent;
+        scene::AABB bin_bounds[BINS];
+        std::size_t bin_count[BINS] = {};
+        for (std::size_t i = begin; i < end; i++) {
+            int bin = std::min(BINS - 1, static_cast<int>((centers[order[i]](axis) - center_bounds.min(axis)) * scale));
+            bin_count[bin]++;
+            bin_bounds[bin].expand(boxes[order[i]]);
+        }
+
+        double left_area[BINS - 1];
+        std::size_t left_count[BINS - 1];
+        scene::AABB left;
+        std::size_t n = 0;
+        for (int plane = 0; plane < BINS - 1; plane++) {
+            left.expand(bin_bounds[plane]);
+            n += bin_count[plane];
+            left_area[plane] = n ? left.surface_area() : 0.0;
+            left_count[plane] = n;
+        }
+        scene::AABB right;
+        n = 0;
+        for (int plane = BINS - 2; plane >= 0; plane--) {
+            right.expand(bin_bounds[plane + 1]);
+            n += bin_count[plane + 1];
+            if (left_count[plane] == 0 || n == 0)
+                continue;
+            double cost = TRAVERSAL_COST + (left_area[plane] * left_count[plane] + right.surface_area() * n) / parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_plane = plane;
+            }
+        }
+    }
+
+    std::size_t middle;
+    if (best_axis >= 0 && (best_cost < count || count > MAX_LEAF_SIZE)) {
+        const int axis = best_axis;
+        const double scale = BINS / (center_bounds.max(axis) - center_bounds.min(axis));
+        const double min = center_bounds.min(axis);
+        middle = std::partition(order.begin() + begin, order.begin() + end, [&](std::size_t i) {
+            return std::min(BINS - 1, static_cast<int>((centers[i](axis) - min) * scale)) <= best_plane;
+        }) - order.begin();
+        nodes[index].axis = axis;
+    } else if (count > MAX_LEAF_SIZE) {
+        // Every center at the same point, no plane separates them but the leaf would still be too large
+        middle = begin + count / 2;
+    } else {
+        return make_leaf();
+    }
+
+    return split(middle);
+}
+
+MeshAccel::MeshAccel(const models::ObjModel& obj) {
+    std::vector<scene::AABB> boxes(obj.faces.size());
+    for (std::size_t f = 0; f < obj.faces.size(); f++) {
+        for (int i = 0; i < 3; i++)
+            boxes[f].expand(obj.vertexes[obj.faces[f][i]]);
+    }
+    bvh = BVH(boxes);
+
+    v0.reserve(obj.faces.size());
+    e1.reserve(obj.faces.size());
+    e2.reserve(obj.faces.size());
+    face.reserve(obj.faces.size());
+    for (std::size_t f : bvh.order) {
+        const auto& a = obj.vertexes[obj.faces[f][0]];
+        v0.push_back(a);
+        e1.push_back(obj.vertexes[obj.faces[f][1]] - a);
+        e2.push_back(obj.vertexes[obj.faces[f][2]] - a);
+        face.push_back(f);
+    }
+}
+
+SceneAccel::SceneAccel(const std::vector<models::Model>& objects, const SceneAccel* previous) {
+    std::unordered_map<const models::ObjModel*, std::size_t> mesh_of;
+    std::vector<scene::AABB> boxes;
+    boxes.reserve(objects.size());
+    for (const auto& object : objects) {
+        const models::ObjModel* obj = object.obj_file.get();
+        auto it = mesh_of.find(obj);
+        if (it == mesh_of.end()) {
+            std::shared_ptr<const MeshAccel> mesh;
+            if (previous) {
+                auto source = std::find(previous->mesh_sources.begin(), previous->mesh_sources.end(), object.obj_file);
+                if (source != previous->mesh_sources.end())
+                    mesh = previous->meshes[source - previous->mesh_sources.begin()];
+            }
+            if (!mesh)
+                mesh = std::make_shared<const MeshAccel>(*obj);
+            it = mesh_of.emplace(obj, meshes.size()).first;
+            meshes.push_back(mesh);
+            mesh_sources.push_back(object.obj_file);
+        }
+        instances.push_back({object.transform.inverse(), it->second});
+        boxes.push_back(scene::world_bounds(object));
+    }
+    top = BVH(boxes);
+}
+
+template <bool ANY_HIT>
+void SceneAccel::traverse(const RayPacket& packet, PacketHit& hit) const {
+    // Lanes still searching, and the nearest hit so far of each lane as the end of its ray
+    Mask active = packet.active;
+    Lanes t_max = packet.t_max;
+    const LocalPacket world(packet);
+
+    traverse_bvh(top, world, packet.t_min, t_max, active, [&](std::uint32_t first, std::uint32_t last) {
+        for (std::uint32_t i = first; i < last; i++) {
+            const std::size_t object = top.order[i];
+            const Instance& instance = instances[object];
+            const MeshAccel& mesh = *meshes[instance.mesh];
+            const LocalPacket local(packet, instance.object_from_world);
+
+            traverse_bvh(mesh.bvh, local, packet.t_min, t_max, active, [&](std::uint32_t begin, std::uint32_t end) {
+                Lanes t, u, v;
+                for (std::uint32_t tri = begin; tri < end; tri++) {
+                    Mask found = local.intersect(mesh.v0[tri], mesh.e1[tri], mesh.e2[tri], packet.t_min, t_max, t, u, v) && active;
+                    if (!found.any())
+                        continue;
+                    hit.hit = hit.hit || found;
+                    if (ANY_HIT) {
+                        active = active && !found;
+                        if (!active.any())
+                            return false;
+                        continue;
+                    }
+                    t_max = found.select(t, t_max);
+                    hit.t = found.select(t, hit.t);
+                    hit.u = found.select(u, hit.u);
+                    hit.v = found.select(v, hit.v);
+                    for (int l = 0; l < RayPacket::SIZE; l++) {
+                        if (found(l)) {
+                            hit.object[l] = object;
+                            hit.face[l] = mesh.face[tri];
+                        }
+                    }
+                }
+                return true;
+            });
+            if (!active.any())
+                return false;
+        }
+        return true;
+    });
+}
+
+PacketHit SceneAccel::intersect(const RayPacket& packet) const {
+    PacketHit hit;
+    traverse<false>(packet, hit);
+    return hit;
+}
+
+Mask SceneAccel::occluded(const RayPacket& packet) const {
+    PacketHit hit;
+    traverse<true>(packet, hit);
+    return hit.hit;
+}
+
+void render(ppm_image::PPMImage<float>& image, const std::vector<models::Model>& objects,
+            const std::vector<scene::PointLight>& lights, const scene::Camera& camera,
+            const rendering::RenderOptions& options, const SceneAccel& accel) {
+    const auto& pattern = rendering::sample_pattern(options.samples);
+    if (pattern.empty()) {
+        std::cerr << "Error: Unsupported sample count " << options.samples << std::endl;
+        return;
+    }
+
+    Tracer tracer{objects, lights, options, accel, {}};
+    if (options.specular_mode == rendering::SPECULAR_TABLE) {
+        for (const auto& object : objects)
+            tracer.specular_tables.try_emplace(object.shininess, object.shininess);
+    }
+
+    // Primary rays through the near plane in eye space, t = 1 on the near plane and f / n on the far plane
+    const int width = static_cast<int>(image.w());
+    const int height = static_cast<int>(image.h());
+    const Eigen::Matrix3d world_from_eye = camera.get_transformation().block<3,3>(0,0);
+    const float inv_samples = 1.0f / static_cast<float>(options.samples);
+
+    auto render_tile = [&](int tile_x, int tile_y) {
+        const int x_end = std::min(width, (tile_x + 1) * TILE_SIZE);
+        const int y_end = std::min(height, (tile_y + 1) * TILE_SIZE);
+        for (int y = tile_y * TILE_SIZE; y < y_end; y += 2) {
+            for (int x = tile_x * TILE_SIZE; x < x_end; x += 2) {
+                PacketColors sums{};
+                for (const auto& [offset_x, offset_y] : pattern) {
+                    RayPacket packet;
+                    for (int l = 0; l < RayPacket::SIZE; l++) {
+                        const int px = x + (l & 1), py = y + (l >> 1);
+                        packet.active(l) = px < x_end && py < y_end;
+                        Eigen::Vector3d direction = world_from_eye * Eigen::Vector3d(
+                            camera.l + (camera.r - camera.l) * (px + 0.5 + offset_x) / width,
+                            camera.b + (camera.t - camera.b) * (py + 0.5 + offset_y) / height, -camera.n);
+                        packet.ox(l) = camera.position.x(); packet.oy(l) = camera.position.y(); packet.oz(l) = camera.position.z();
+                        packet.dx(l) = direction.x(); packet.dy(l) = direction.y(); packet.dz(l) = direction.z();
+                        packet.t_min(l) = 1.0;
+                        packet.t_max(l) = camera.f / camera.n;
+                    }
+                    PacketColors colors = tracer.trace(packet, 0);
+                    for (int l = 0; l < RayPacket::SIZE; l++)
+                        sums[l] += colors[l];
+                }
+                for (int l = 0; l < RayPacket::SIZE; l++) {
+                    const int px = x + (l & 1), py = y + (l >> 1);
+                    if (px < x_end && py < y_end)
+                        image[py][px] = sums[l] * inv_samples;
+                }
+            }
+        }
+    };
+
+    const int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const int tile_count = tiles_x * tiles_y;
+    std::atomic<int> next_tile{0};
+    auto work = [&]() {
+        for (int tile = next_tile++; tile < tile_count; tile = next_tile++)
+            render_tile(tile % tiles_x, tile / tiles_x);
+    };
+
+    const int worker_count = std::max(1, std::min(options.threads, tile_count));
+    if (worker_count == 1) {
+        work();
+        return;
+    }
+
+    // Workers record into their own stats, merged into the session of the calling thread at the end
+    profiler::Stats* caller_stats = profiler::active();
+    std::vector<profiler::Stats> worker_stats(worker_count);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < worker_count; w++) {
+        workers.emplace_back([&, w]() {
+            profiler::Session session(caller_stats ? &worker_stats[w] : nullptr);
+            work();
+        });
+    }
+    for (auto& thread : workers)
+        thread.join();
+    if (caller_stats) {
+        for (const auto& stats : worker_stats)
+            caller_stats->merge(stats);
+    }
+}
+
+} // namespace raytracing
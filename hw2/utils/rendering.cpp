@@ -1,15 +1,21 @@
 #include <Eigen/Dense>
 #include <cmath>
 #include <algorithm>
+#include <iostream>
+#include <limits>
+#include <type_traits>
 #include "rendering.h"
 #include "ppm_image.h"
 #include "models.h"
 #include "scene.h"
 #include "shader.h"
+#include "shadow.h"
+#include "profiler.h"
 
 namespace rendering {
 
-ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal, const models::Model& model, const std::vector<scene::PointLight>& lights, const Eigen::Vector3d& eye_pos) {
+ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal, const models::Model& model, const std::vector<scene::PointLight>& lights, const Eigen::Vector3d& eye_pos,
+                                 const SpecularTable* specular_table) {
     
     
     
@@ -20,21 +26,43 @@ ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d
     
     for (const auto& light : lights) {
         Eigen::Vector3d L_vec = light.position - P;
-        double distance = L_vec.norm();
-        Eigen::Vector3d L_dir = L_vec.normalized();
+        double distance_squared = L_vec.squaredNorm();
+
+        // Skip lights too far away to contribute more than PointLight::ATTENUATION_CUTOFF
+        if (distance_squared > light.influence_radius * light.influence_radius)
+            continue;
+
+        // Shadow map visibility, fully shadowed points get nothing from this light
+        double visibility = light.shadow ? light.shadow->visibility(P, normal) : 1.0;
+        if (visibility <= 0)
+            continue;
+
+        // A light exactly at P has no direction, normalized() gives the zero vector for it as well
+        double distance = std::sqrt(distance_squared);
+        Eigen::Vector3d L_dir = (distance > 0) ? Eigen::Vector3d(L_vec / distance) : Eigen::Vector3d::Zero();
         
         // Distance attenuation
         // double attenuation = 1.0;
         double attenuation = 1.0 / (1.0 + light.k * distance * distance);
+        if (light.shadow)
+            attenuation *= visibility;
         
-        // Diffuse component
-        ppm_image::Pixel<float> L_diffuse = light.color * std::max(0.0, normal.dot(L_dir)) * attenuation;
-        diffuse_sum += L_diffuse;
+        // Diffuse component, zero when the light is behind the surface
+        double n_dot_l = normal.dot(L_dir);
+        if (n_dot_l > 0) {
+            ppm_image::Pixel<float> L_diffuse = light.color * n_dot_l * attenuation;
+            diffuse_sum += L_diffuse;
+        }
 
-        // Specular component
+        // Specular component, skip the pow() when the half vector faces away. Shininess 0 still gets the light,
+        // pow(0, 0) = 1.
         Eigen::Vector3d half_vector = (e_dir + L_dir).normalized();
-        ppm_image::Pixel<float> L_specular = light.color * std::pow(std::max(0.0, normal.dot(half_vector)), model.shininess) * attenuation;
-        specular_sum += L_specular;
+        double n_dot_h = std::max(0.0, normal.dot(half_vector));
+        if (n_dot_h > 0 || model.shininess <= 0) {
+            double power = specular_table ? (*specular_table)(n_dot_h) : std::pow(n_dot_h, model.shininess);
+            ppm_image::Pixel<float> L_specular = light.color * power * attenuation;
+            specular_sum += L_specular;
+        }
     }
     
     ppm_image::Pixel<float> result;
@@ -50,89 +78,532 @@ ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d
 }
 
 
+SpecularTable::SpecularTable(float shininess): shininess(shininess), max_error(0.0), exact_below(0.0), values(SIZE) {
+    const double h = 1.0 / (SIZE - 1);
+    for (std::size_t i = 0; i < SIZE; i++)
+        values[i] = static_cast<float>(std::pow(i * h, static_cast<double>(shininess)));
+
+    // Measure the interpolation error inside every interval, including the float rounding of the entries.
+    // Intervals over the tolerance are allowed at the start of the range only, they are handed to std::pow.
+    std::size_t first_tabulated = 0;
+    for (std::size_t i = 0; i + 1 < SIZE; i++) {
+        double interval_error = 0.0;
+        for (int c = 1; c < CHECKS_PER_INTERVAL; c++) {
+            double x = (i + static_cast<double>(c) / CHECKS_PER_INTERVAL) * h;
+            double t = x * (SIZE - 1) - i;
+            double interpolated = values[i] + t * (values[i + 1] - values[i]);
+            interval_error = std::max(interval_error, std::abs(interpolated - std::pow(x, static_cast<double>(shininess))));
+        }
+
+        if (interval_error <= TOLERANCE) {
+            max_error = std::max(max_error, interval_error);
+        } else if (i == first_tabulated) {
+            first_tabulated = i + 1;
+        } else {
+            values.clear();
+            max_error = 0.0;
+            return;
+        }
+    }
+
+    exact_below = first_tabulated * h;
+    if (first_tabulated + 1 >= SIZE)
+        values.clear();
+}
+
+
+PackedLights::PackedLights(const std::vector<scene::PointLight>& lights): count(lights.size()) {
+    const std::size_t padded = (count + LIGHT_LANES - 1) / LIGHT_LANES * LIGHT_LANES;
+    x.assign(padded, 0.0f); y.assign(padded, 0.0f); z.assign(padded, 0.0f);
+    r.assign(padded, 0.0f); g.assign(padded, 0.0f); b.assign(padded, 0.0f);
+    k.assign(padded, 0.0f);
+    radius_squared.assign(padded, -1.0f);
+    shadows.assign(padded, nullptr);
+
+    for (std::size_t i = 0; i < count; i++) {
+        const auto& light = lights[i];
+        x[i] = static_cast<float>(light.position.x());
+        y[i] = static_cast<float>(light.position.y());
+        z[i] = static_cast<float>(light.position.z());
+        r[i] = light.color.r;
+        g[i] = light.color.g;
+        b[i] = light.color.b;
+        k[i] = static_cast<float>(light.k);
+        radius_squared[i] = static_cast<float>(std::min(light.influence_radius * light.influence_radius,
+                                                        static_cast<double>(std::numeric_limits<float>::max())));
+        shadows[i] = light.shadow.get();
+        has_shadows = has_shadows || light.shadow;
+    }
+}
+
+ppm_image::Pixel<float> lighting(const Eigen::Vector3d& P, const Eigen::Vector3d& normal, const models::Model& model, const PackedLights& lights, const Eigen::Vector3d& eye_pos,
+                                 const SpecularTable* specular_table) {
+    const float px = static_cast<float>(P.x()), py = static_cast<float>(P.y()), pz = static_cast<float>(P.z());
+    const float nx = static_cast<float>(normal.x()), ny = static_cast<float>(normal.y()), nz = static_cast<float>(normal.z());
+    Eigen::Vector3d e_dir = (eye_pos - P).normalized();
+    const float ex = static_cast<float>(e_dir.x()), ey = static_cast<float>(e_dir.y()), ez = static_cast<float>(e_dir.z());
+
+    // Per lane accumulators, summed once at the end so the loops below stay free of cross-lane dependencies
+    float diffuse_r[LIGHT_LANES] = {}, diffuse_g[LIGHT_LANES] = {}, diffuse_b[LIGHT_LANES] = {};
+    float specular_r[LIGHT_LANES] = {}, specular_g[LIGHT_LANES] = {}, specular_b[LIGHT_LANES] = {};
+    float n_dot_h[LIGHT_LANES];
+    float attenuation[LIGHT_LANES];
+    float visibility[LIGHT_LANES];
+    std::fill(visibility, visibility + LIGHT_LANES, 1.0f);
+
+    for (std::size_t base = 0; base < lights.x.size(); base += LIGHT_LANES) {
+        // Shadow lookups are scalar, they run ahead of the vectorized loop
+        if (lights.has_shadows) {
+            for (std::size_t i = 0; i < LIGHT_LANES; i++) {
+                const ShadowCubeMap* shadow = lights.shadows[base + i];
+                visibility[i] = shadow ? static_cast<float>(shadow->visibility(P, normal)) : 1.0f;
+            }
+        }
+
+        // Diffuse, half vector and attenuation for all lanes, branch free
+        for (std::size_t i = 0; i < LIGHT_LANES; i++) {
+            const std::size_t l = base + i;
+            float lx = lights.x[l] - px, ly = lights.y[l] - py, lz = lights.z[l] - pz;
+            float distance_squared = lx * lx + ly * ly + lz * lz;
+            float inv_distance = (distance_squared > 0.0f) ? 1.0f / std::sqrt(distance_squared) : 0.0f;
+            lx *= inv_distance; ly *= inv_distance; lz *= inv_distance;
+
+            float in_range = (distance_squared <= lights.radius_squared[l]) ? 1.0f : 0.0f;
+            float att = in_range * visibility[i] / (1.0f + lights.k[l] * distance_squared);
+
+            float n_dot_l = std::max(0.0f, nx * lx + ny * ly + nz * lz) * att;
+            diffuse_r[i] += lights.r[l] * n_dot_l;
+            diffuse_g[i] += lights.g[l] * n_dot_l;
+            diffuse_b[i] += lights.b[l] * n_dot_l;
+
+            float hx = ex + lx, hy = ey + ly, hz = ez + lz;
+            float inv_h = 1.0f / std::sqrt(hx * hx + hy * hy + hz * hz);
+            n_dot_h[i] = std::max(0.0f, (nx * hx + ny * hy + nz * hz) * inv_h);
+            attenuation[i] = att;
+        }
+
+        // Specular power only for the lanes that contribute, as in the exact lighting()
+        for (std::size_t i = 0; i < LIGHT_LANES; i++) {
+            if ((n_dot_h[i] > 0.0f || model.shininess <= 0) && attenuation[i] > 0.0f) {
+                const std::size_t l = base + i;
+                float power = specular_table ? static_cast<float>((*specular_table)(n_dot_h[i]))
+                                             : std::pow(n_dot_h[i], model.shininess);
+                float specular = power * attenuation[i];
+                specular_r[i] += lights.r[l] * specular;
+                specular_g[i] += lights.g[l] * specular;
+                specular_b[i] += lights.b[l] * specular;
+            }
+        }
+    }
+
+    ppm_image::Pixel<float> diffuse_sum(0.0f, 0.0f, 0.0f);
+    ppm_image::Pixel<float> specular_sum(0.0f, 0.0f, 0.0f);
+    for (std::size_t i = 0; i < LIGHT_LANES; i++) {
+        diffuse_sum += ppm_image::Pixel<float>(diffuse_r[i], diffuse_g[i], diffuse_b[i]);
+        specular_sum += ppm_image::Pixel<float>(specular_r[i], specular_g[i], specular_b[i]);
+    }
+
+    ppm_image::Pixel<float> result;
+    const ppm_image::Pixel<float>& Ca = model.ambient;
+    const ppm_image::Pixel<float>& Cs = model.specular;
+    const ppm_image::Pixel<float>& Cd = model.diffuse;
+    result.r = Ca.r + diffuse_sum.r*Cd.r + specular_sum.r*Cs.r;
+    result.g = Ca.g + diffuse_sum.g*Cd.g + specular_sum.g*Cs.g;
+    result.b = Ca.b + diffuse_sum.b*Cd.b + specular_sum.b*Cs.b;
+    result.clamp(1.0);
+
+    return result;
+}
+
+
+ScreenRect screen_bounds(const models::Model& model, const scene::Camera& camera, std::size_t width, std::size_t height) {
+    const Eigen::Vector3d& lo = model.obj_file->bound_min;
+    const Eigen::Vector3d& hi = model.obj_file->bound_max;
+    Eigen::Matrix4d T_clip = camera.get_perspective_projection_matrix() * camera.get_transformation().inverse() * model.transform;
+
+    double xmin = std::numeric_limits<double>::infinity(), xmax = -xmin;
+    double ymin = xmin, ymax = -xmin;
+    for (int corner = 0; corner < 8; corner++) {
+        Eigen::Vector4d p((corner & 1) ? hi.x() : lo.x(), (corner & 2) ? hi.y() : lo.y(), (corner & 4) ? hi.z() : lo.z(), 1.0);
+        Eigen::Vector4d clip = T_clip * p;
+        // Projections of points behind the camera flip, give up on a tight bound
+        if (clip.w() <= 0)
+            return ScreenRect::full(width, height);
+        Eigen::Vector3d ndc = clip.head<3>() / clip.w();
+        auto [x, y] = ndc_to_screen_subpixel(ndc, width, height);
+        xmin = std::min(xmin, x); xmax = std::max(xmax, x);
+        ymin = std::min(ymin, y); ymax = std::max(ymax, y);
+    }
+
+    // One pixel of margin around the floor of the projected box covers both the truncating and the sub-pixel rasterizer
+    ScreenRect rect = {static_cast<int>(std::floor(std::max(xmin, -1e6))) - 1, static_cast<int>(std::floor(std::max(ymin, -1e6))) - 1,
+                       static_cast<int>(std::floor(std::min(xmax, 1e6))) + 1, static_cast<int>(std::floor(std::min(ymax, 1e6))) + 1};
+    return rect.clipped(width, height);
+}
 
-void render_object(ppm_image::PPMImage<float>& image, const models::Model& model, const scene::Camera& camera, shader::Shader& shader, Eigen::MatrixXd& z_buffer) {
+void render_object(ppm_image::PPMImage<float>& image, const models::Model& model, const scene::Camera& camera, shader::Shader& shader, Eigen::MatrixXd& z_buffer,
+                   std::optional<ScreenRect> scissor_rect) {
+    const ScreenRect scissor = scissor_rect.value_or(ScreenRect::full(image.w(), image.h())).clipped(image.w(), image.h());
     // Draw vertices for now
     Eigen::Matrix4d T_ndc_pt = camera.get_perspective_projection_matrix() * camera.get_transformation().inverse();
-    Eigen::Matrix4Xd vertexes_homo = model.points_homo_transformed();
-    Eigen::Matrix3Xd vertexes = transformation::points_homo_to_points_3d(vertexes_homo);
-    Eigen::Matrix3Xd normals = model.normals_transformed();
-    Eigen::Matrix3Xd ndc_points = transformation::points_homo_to_points_3d(T_ndc_pt *  vertexes_homo);
-    Eigen::VectorXi points_within_ndc_cube = rendering::compute_within_ndc_cube_mask(ndc_points);
+    Eigen::Matrix4Xd vertexes_homo;
+    Eigen::Matrix3Xd vertexes;
+    Eigen::Matrix3Xd normals;
+    Eigen::Matrix3Xd ndc_points;
+    {
+        profiler::ScopedTimer timer(profiler::VERTEX_TRANSFORM);
+        vertexes_homo = model.points_homo_transformed();
+        vertexes = transformation::points_homo_to_points_3d(vertexes_homo);
+        normals = model.normals_transformed();
+    }
+    {
+        profiler::ScopedTimer timer(profiler::PROJECTION);
+        ndc_points = transformation::points_homo_to_points_3d(T_ndc_pt *  vertexes_homo);
+    }
     
-    for (const auto& face: model.faces()) {
-        // if (points_within_ndc_cube(face[0]) > 0 && points_within_ndc_cube(face[1]) > 0 && points_within_ndc_cube(face[2]) > 0) {
-            Eigen::Vector3d ndc_a = ndc_points.col(face[0]);
-            Eigen::Vector3d ndc_b = ndc_points.col(face[1]);
-            Eigen::Vector3d ndc_c = ndc_points.col(face[2]);
-            Eigen::Vector3d cross = (ndc_b - ndc_a).cross(ndc_c - ndc_a);
-            if (cross.z() > 0) {
+    // Counted locally and reported once, so the inner loop stays free of profiler calls
+    std::uint64_t culled = 0, rasterized = 0, tested = 0, shaded = 0, overdraw = 0;
+
+    // One timer over the triangle loop, the triangle setup and shading inside it are sampled and taken out of it,
+    // which leaves the coverage tests
+    profiler::ScopedTimer coverage_timer(profiler::COVERAGE);
+    profiler::SampledTimer setup_timer(profiler::TRIANGLE_SETUP);
+    profiler::SampledTimer shading_timer(profiler::SHADING);
+
+    // The loop is compiled twice, the untimed copy used without a session has no clock reads or branches for them
+    auto rasterize = [&](auto timed) {
+        constexpr bool TIMED = decltype(timed)::value;
+        for (const auto& face: model.faces()) {
+            Eigen::Vector3d ndc_a, ndc_b, ndc_c;
+            int xa, ya, xb, yb, xc, yc;
+            int xmin, xmax, ymin, ymax;
+            {
+                profiler::SampledTimer::Scope<TIMED> setup(setup_timer);
+                ndc_a = ndc_points.col(face[0]);
+                ndc_b = ndc_points.col(face[1]);
+                ndc_c = ndc_points.col(face[2]);
+                Eigen::Vector3d cross = (ndc_b - ndc_a).cross(ndc_c - ndc_a);
+                if (!shaded_face_visible(cross.z(), model.cull)) {
+                    culled++;
+                    continue;
+                }
+                std::tie(xa, ya) = ndc_to_screen(ndc_a, image.w(), image.h());
+                std::tie(xb, yb) = ndc_to_screen(ndc_b, image.w(), image.h());
+                std::tie(xc, yc) = ndc_to_screen(ndc_c, image.w(), image.h());
+
+                xmin = std::max(scissor.xmin, std::min(xa, std::min(xb, xc)));
+                xmax = std::min(scissor.xmax, std::max(xa, std::max(xb, xc)));
+                ymin = std::max(scissor.ymin, std::min(ya, std::min(yb, yc)));
+                ymax = std::min(scissor.ymax, std::max(ya, std::max(yb, yc)));
+            }
+            // Off screen or outside the scissor, skip the shading setup too
+            if (xmin > xmax || ymin > ymax)
+                continue;
+
+            rasterized++;
+            {
+                profiler::SampledTimer::Scope<TIMED> shading(shading_timer);
                 shader.new_triangle(vertexes.col(face[0]), vertexes.col(face[1]), vertexes.col(face[2]),
                                     normals.col(face[3]), normals.col(face[4]), normals.col(face[5]));
+            }
 
-                auto [xa, ya] = ndc_to_screen(ndc_a, image.w(), image.h());
-                auto [xb, yb] = ndc_to_screen(ndc_b, image.w(), image.h());
-                auto [xc, yc] = ndc_to_screen(ndc_c, image.w(), image.h());
+            for (int x = xmin; x <= xmax; x++) {
+                for (int y = ymin; y <= ymax; y++) {
+                    auto [alpha, beta, gamma] = compute_alpha_beta_gamma(xa, ya, xb, yb, xc, yc, x, y);
+                    if (alpha >= 0 && beta >= 0 && gamma >= 0 && alpha <= 1 && beta <= 1 && gamma <= 1) {
+                        tested++;
+                        Eigen::Vector3d ndc = alpha * ndc_a + beta * ndc_b + gamma * ndc_c;
+                        if (within_ndc_cube(ndc) && ndc.z() < z_buffer(y, x)) {
+                            shaded++;
+                            if (z_buffer(y, x) < 1.0)
+                                overdraw++;
+                            z_buffer(y, x) = ndc.z();
+                            ppm_image::Pixel<float> color;
+                            {
+                                profiler::SampledTimer::Scope<TIMED> shading(shading_timer);
+                                color = shader.compute_color(alpha, beta, gamma);
+                            }
+                            color.clamp(1.0);
+                            image[y][x] = color;
+                        }
+                    }
+                }
+            }
+        }
+    };
+    if (setup_timer.recording())
+        rasterize(std::true_type{});
+    else
+        rasterize(std::false_type{});
+
+    profiler::SampledTimer::report(coverage_timer, {&setup_timer, &shading_timer});
+    profiler::count(profiler::TRIANGLES_CULLED, culled);
+    profiler::count(profiler::TRIANGLES_RASTERIZED, rasterized);
+    profiler::count(profiler::FRAGMENTS_TESTED, tested);
+    profiler::count(profiler::FRAGMENTS_SHADED, shaded);
+    profiler::count(profiler::OVERDRAW, overdraw);
+}
+
+const std::vector<std::pair<double, double>>& sample_pattern(int samples) {
+    // Offsets in 1/16 pixel units, same as the D3D standard multisample patterns
+    static const std::vector<std::pair<double, double>> pattern_1 = {{0.0, 0.0}};
+    static const std::vector<std::pair<double, double>> pattern_2 = {
+        {4 / 16.0, 4 / 16.0}, {-4 / 16.0, -4 / 16.0}};
+    static const std::vector<std::pair<double, double>> pattern_4 = {
+        {-2 / 16.0, -6 / 16.0}, {6 / 16.0, -2 / 16.0}, {-6 / 16.0, 2 / 16.0}, {2 / 16.0, 6 / 16.0}};
+    static const std::vector<std::pair<double, double>> pattern_8 = {
+        {1 / 16.0, -3 / 16.0}, {-1 / 16.0, 3 / 16.0}, {5 / 16.0, 1 / 16.0}, {-3 / 16.0, -5 / 16.0},
+        {-5 / 16.0, 5 / 16.0}, {-7 / 16.0, -1 / 16.0}, {3 / 16.0, 7 / 16.0}, {7 / 16.0, -7 / 16.0}};
+    static const std::vector<std::pair<double, double>> unsupported;
+
+    switch (samples) {
+        case 1: return pattern_1;
+        case 2: return pattern_2;
+        case 4: return pattern_4;
+        case 8: return pattern_8;
+        default: return unsupported;
+    }
+}
+
+MultisampleBuffer::MultisampleBuffer(std::size_t height, std::size_t width, int samples)
+    : width(width), height(height), samples(samples),
+      colors(width * height * samples, ppm_image::colors_f::BLACK),
+      depths(width * height * samples, 1.0) {}
+
+void MultisampleBuffer::clear() {
+    std::fill(colors.begin(), colors.end(), ppm_image::colors_f::BLACK);
+    std::fill(depths.begin(), depths.end(), 1.0);
+}
+
+void MultisampleBuffer::clear(const ScreenRect& rect) {
+    for (int y = rect.ymin; y <= rect.ymax; ++y) {
+        for (int x = rect.xmin; x <= rect.xmax; ++x) {
+            for (int s = 0; s < samples; ++s) {
+                colors[index(y, x, s)] = ppm_image::colors_f::BLACK;
+                depths[index(y, x, s)] = 1.0;
+            }
+        }
+    }
+}
+
+void MultisampleBuffer::resolve(ppm_image::PPMImage<float>& image, const ScreenRect& rect) const {
+    const float inv_samples = 1.0f / static_cast<float>(samples);
+    for (int y = rect.ymin; y <= rect.ymax; ++y) {
+        for (int x = rect.xmin; x <= rect.xmax; ++x) {
+            ppm_image::Pixel<float> sum;
+            for (int s = 0; s < samples; ++s)
+                sum += colors[index(y, x, s)];
+            image[y][x] = sum * inv_samples;
+        }
+    }
+}
 
-                int xmin = std::max(0, std::min(xa, std::min(xb, xc)));
-                int xmax = std::min(static_cast<int>(image.w()), std::max(xa, std::max(xb, xc)));
-                int ymin = std::max(0, std::min(ya, std::min(yb, yc)));
-                int ymax = std::min(static_cast<int>(image.h()), std::max(ya, std::max(yb, yc)));
+void MultisampleBuffer::resolve(ppm_image::PPMImage<float>& image) const {
+    const float inv_samples = 1.0f / static_cast<float>(samples);
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            ppm_image::Pixel<float> sum;
+            for (int s = 0; s < samples; ++s)
+                sum += colors[index(y, x, s)];
+            image[y][x] = sum * inv_samples;
+        }
+    }
+}
+
+void render_object(MultisampleBuffer& buffer, const models::Model& model, const scene::Camera& camera, shader::Shader& shader,
+                   std::optional<ScreenRect> scissor_rect) {
+    const ScreenRect scissor = scissor_rect.value_or(ScreenRect::full(buffer.width, buffer.height)).clipped(buffer.width, buffer.height);
+    const auto& pattern = sample_pattern(buffer.samples);
+    if (pattern.empty()) {
+        std::cerr << "Error: Unsupported sample count " << buffer.samples << std::endl;
+        return;
+    }
 
-                for (int x = xmin; x <= xmax; x++) {
-                    for (int y = ymin; y <= ymax; y++) {
-                        auto [alpha, beta, gamma] = compute_alpha_beta_gamma(xa, ya, xb, yb, xc, yc, x, y);
+    Eigen::Matrix4d T_ndc_pt = camera.get_perspective_projection_matrix() * camera.get_transformation().inverse();
+    Eigen::Matrix4Xd vertexes_homo;
+    Eigen::Matrix3Xd vertexes;
+    Eigen::Matrix3Xd normals;
+    Eigen::Matrix3Xd ndc_points;
+    {
+        profiler::ScopedTimer timer(profiler::VERTEX_TRANSFORM);
+        vertexes_homo = model.points_homo_transformed();
+        vertexes = transformation::points_homo_to_points_3d(vertexes_homo);
+        normals = model.normals_transformed();
+    }
+    {
+        profiler::ScopedTimer timer(profiler::PROJECTION);
+        ndc_points = transformation::points_homo_to_points_3d(T_ndc_pt *  vertexes_homo);
+    }
+
+    std::uint64_t culled = 0, rasterized = 0, tested = 0, shaded = 0, overdraw = 0;
+    double sample_z[8];
+
+    // Timed like the single sample render_object(): sampled setup and shading, the rest of the loop is coverage
+    profiler::ScopedTimer coverage_timer(profiler::COVERAGE);
+    profiler::SampledTimer setup_timer(profiler::TRIANGLE_SETUP);
+    profiler::SampledTimer shading_timer(profiler::SHADING);
+
+    // Untimed copy of the loop without a session, as above
+    auto rasterize = [&](auto timed) {
+        constexpr bool TIMED = decltype(timed)::value;
+        for (const auto& face: model.faces()) {
+            Eigen::Vector3d ndc_a, ndc_b, ndc_c;
+            double xa, ya, xb, yb, xc, yc;
+            int xmin, xmax, ymin, ymax;
+            {
+                profiler::SampledTimer::Scope<TIMED> setup(setup_timer);
+                ndc_a = ndc_points.col(face[0]);
+                ndc_b = ndc_points.col(face[1]);
+                ndc_c = ndc_points.col(face[2]);
+                Eigen::Vector3d cross = (ndc_b - ndc_a).cross(ndc_c - ndc_a);
+                if (!shaded_face_visible(cross.z(), model.cull)) {
+                    culled++;
+                    continue;
+                }
+                std::tie(xa, ya) = ndc_to_screen_subpixel(ndc_a, buffer.width, buffer.height);
+                std::tie(xb, yb) = ndc_to_screen_subpixel(ndc_b, buffer.width, buffer.height);
+                std::tie(xc, yc) = ndc_to_screen_subpixel(ndc_c, buffer.width, buffer.height);
+
+                xmin = std::max(scissor.xmin, static_cast<int>(std::floor(std::min({xa, xb, xc}))));
+                xmax = std::min(scissor.xmax, static_cast<int>(std::floor(std::max({xa, xb, xc}))));
+                ymin = std::max(scissor.ymin, static_cast<int>(std::floor(std::min({ya, yb, yc}))));
+                ymax = std::min(scissor.ymax, static_cast<int>(std::floor(std::max({ya, yb, yc}))));
+            }
+            // Off screen or outside the scissor, skip the shading setup too
+            if (xmin > xmax || ymin > ymax)
+                continue;
+
+            rasterized++;
+            {
+                profiler::SampledTimer::Scope<TIMED> shading(shading_timer);
+                shader.new_triangle(vertexes.col(face[0]), vertexes.col(face[1]), vertexes.col(face[2]),
+                                    normals.col(face[3]), normals.col(face[4]), normals.col(face[5]));
+            }
+
+            // Sub-pixel positions need full double precision, barycentric_f() would round them to float
+            // and leave uncovered samples along shared edges
+            const double area = (xb - xa) * (yc - ya) - (xc - xa) * (yb - ya);
+            auto barycentric = [&](double px, double py) {
+                double alpha = ((xb - px) * (yc - py) - (xc - px) * (yb - py)) / area;
+                double beta = ((xc - px) * (ya - py) - (xa - px) * (yc - py)) / area;
+                return std::make_tuple(alpha, beta, 1.0 - alpha - beta);
+            };
+
+            for (int x = xmin; x <= xmax; x++) {
+                for (int y = ymin; y <= ymax; y++) {
+                    // Coverage and depth test for every sample, remember the covered ones in a bit mask
+                    unsigned int covered = 0;
+                    int count = 0;
+                    double centroid_x = 0.0, centroid_y = 0.0;
+                    for (int s = 0; s < buffer.samples; s++) {
+                        double px = x + 0.5 + pattern[s].first;
+                        double py = y + 0.5 + pattern[s].second;
+                        auto [alpha, beta, gamma] = barycentric(px, py);
                         if (alpha >= 0 && beta >= 0 && gamma >= 0 && alpha <= 1 && beta <= 1 && gamma <= 1) {
-                            
+                            tested++;
                             Eigen::Vector3d ndc = alpha * ndc_a + beta * ndc_b + gamma * ndc_c;
-                            if (within_ndc_cube(ndc) && ndc.z() < z_buffer(y, x)) {
-                                z_buffer(y, x) = ndc.z();
-                                ppm_image::Pixel<float> color = shader.compute_color(alpha, beta, gamma);
-                                color.clamp(1.0);
-                                image[y][x] = color;
+                            if (within_ndc_cube(ndc) && ndc.z() < buffer.depths[buffer.index(y, x, s)]) {
+                                covered |= 1u << s;
+                                count++;
+                                sample_z[s] = ndc.z();
+                                centroid_x += px;
+                                centroid_y += py;
                             }
                         }
                     }
+                    if (covered == 0)
+                        continue;
+
+                    // Shade once per pixel, move the shading point to the centroid of covered samples if the center is not covered
+                    auto [alpha, beta, gamma] = barycentric(x + 0.5, y + 0.5);
+                    if (!(alpha >= 0 && beta >= 0 && gamma >= 0)) {
+                        std::tie(alpha, beta, gamma) = barycentric(centroid_x / count, centroid_y / count);
+                    }
+                    ppm_image::Pixel<float> color;
+                    {
+                        profiler::SampledTimer::Scope<TIMED> shading(shading_timer);
+                        color = shader.compute_color(alpha, beta, gamma);
+                    }
+                    color.clamp(1.0);
+                    shaded++;
+
+                    bool replaced = false;
+                    for (int s = 0; s < buffer.samples; s++) {
+                        if (covered & (1u << s)) {
+                            replaced = replaced || buffer.depths[buffer.index(y, x, s)] < 1.0;
+                            buffer.depths[buffer.index(y, x, s)] = sample_z[s];
+                            buffer.colors[buffer.index(y, x, s)] = color;
+                        }
+                    }
+                    if (replaced)
+                        overdraw++;
                 }
             }
-              
-        // }
-    }
+        }
+    };
+    if (setup_timer.recording())
+        rasterize(std::true_type{});
+    else
+        rasterize(std::false_type{});
+
+    profiler::SampledTimer::report(coverage_timer, {&setup_timer, &shading_timer});
+    profiler::count(profiler::TRIANGLES_CULLED, culled);
+    profiler::count(profiler::TRIANGLES_RASTERIZED, rasterized);
+    profiler::count(profiler::FRAGMENTS_TESTED, tested);
+    profiler::count(profiler::FRAGMENTS_SHADED, shaded);
+    profiler::count(profiler::OVERDRAW, overdraw);
 }
 
 void draw_object_edges(ppm_image::PPMImage<float>& image, const models::Model& model, 
-    const scene::Camera& camera, ppm_image::Pixel<float> color) {
-    // Draw vertices for now
-    
+    const scene::Camera& camera, ppm_image::Pixel<float> color, LineMode line_mode) {
     Eigen::Matrix4d T_ndc_pt = camera.get_perspective_projection_matrix() * camera.get_transformation().inverse();
     Eigen::Matrix3Xd ndc_points = transformation::points_homo_to_points_3d(T_ndc_pt *  model.points_homo_transformed());
-    Eigen::VectorXi points_within_ndc_cube = rendering::compute_within_ndc_cube_mask(ndc_points);
+    draw_edges(image, ndc_points, model.faces(), model.edges(), model.cull, color, line_mode);
+}
 
-    for (const auto& face: model.faces()) {
+std::vector<bool> compute_front_facing(const Eigen::Matrix3Xd& ndc_points, const models::ObjModel::FaceList& faces) {
+    std::vector<bool> front_facing(faces.size());
+    for (std::size_t f = 0; f < faces.size(); f++) {
+        Eigen::Vector3d ndc_a = ndc_points.col(faces[f][0]);
+        Eigen::Vector3d ndc_b = ndc_points.col(faces[f][1]);
+        Eigen::Vector3d ndc_c = ndc_points.col(faces[f][2]);
+        front_facing[f] = (ndc_b - ndc_a).cross(ndc_c - ndc_a).z() > 0;
+    }
+    return front_facing;
+}
 
-        for (int i=0; i<3; i++) {
-            int start_point_idx = face[i];
-            int end_point_idx = face[(i+1)%3];
+void draw_edges(ppm_image::PPMImage<float>& image, const Eigen::Matrix3Xd& ndc_points,
+    const models::ObjModel::FaceList& faces, const models::ObjModel::EdgeList& edges,
+    models::CullMode cull, ppm_image::Pixel<float> color, LineMode line_mode) {
+    Eigen::VectorXi points_within_ndc_cube = rendering::compute_within_ndc_cube_mask(ndc_points);
 
-            if (points_within_ndc_cube(start_point_idx) > 0 || points_within_ndc_cube(end_point_idx) > 0) {
-            
-                auto [x0, y0] = ndc_to_screen(ndc_points.col(start_point_idx), image.w(), image.h());
-                auto [x1, y1] = ndc_to_screen(ndc_points.col(end_point_idx), image.w(), image.h());            
-                // int x0 = static_cast<int>((ndc_points(0, start_point_idx) + 1.0) / 2.0 * image.w());
-                // int y0 = static_cast<int>((1.0 - ndc_points(1, start_point_idx)) / 2.0 * image.h());
-                // int x1 = static_cast<int>((ndc_points(0, end_point_idx) + 1.0) / 2.0 * image.w());
-                // int y1 = static_cast<int>((1.0 - ndc_points(1, end_point_idx)) / 2.0 * image.h());
+    // Decide the facing once per face, culled edges are dropped before any rasterization
+    const bool culling = cull != models::CULL_NONE && cull != models::CULL_DEFAULT;
+    std::vector<bool> front_facing;
+    if (culling)
+        front_facing = compute_front_facing(ndc_points, faces);
 
-                // std::cout << ndc_points(0, start_point_idx) << "; " << ndc_points(0, end_point_idx) << std::endl;
+    auto fill = [&](int x, int y, float alpha){
+        if (x >= 0 && x < static_cast<int>(image.w()) && y >= 0 && y < static_cast<int>(image.h())) {
+            image[y][x] = image[y][x] * (1 - alpha) + color * alpha;
+        }
+    };
 
-                rendering::bresenham_draw_line(x0, y0, x1, y1, [&](int x, int y, float alpha){
-                    if (x >= 0 && x < static_cast<int>(image.w()) && y >= 0 && y < static_cast<int>(image.h())) {
-                        image[y][x] = image[y][x] * (1 - alpha) + color * alpha;
-                    }
-                    // std::cout << "filling " << y << " " << x << std::endl;
-                });
+    for (const auto& edge : edges) {
+        if (points_within_ndc_cube(edge.v0) == 0 && points_within_ndc_cube(edge.v1) == 0)
+            continue;
+        if (culling && !edge_visible(edge, front_facing, cull))
+            continue;
 
-            }
+        if (line_mode == XIAOLIN_WU) {
+            // Shift by half a pixel so that pixel centers sit on integer coordinates as wu_draw_line() expects
+            auto [x0, y0] = ndc_to_screen_subpixel(ndc_points.col(edge.v0), image.w(), image.h());
+            auto [x1, y1] = ndc_to_screen_subpixel(ndc_points.col(edge.v1), image.w(), image.h());
+            rendering::wu_draw_line(x0 - 0.5, y0 - 0.5, x1 - 0.5, y1 - 0.5, fill);
+        } else {
+            auto [x0, y0] = ndc_to_screen(ndc_points.col(edge.v0), image.w(), image.h());
+            auto [x1, y1] = ndc_to_screen(ndc_points.col(edge.v1), image.w(), image.h());
+            rendering::bresenham_draw_line(x0, y0, x1, y1, fill);
         }
     }
 }
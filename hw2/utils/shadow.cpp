@@ -0,0 +1,114 @@
+#include <Eigen/Dense>
+#include <cmath>
+#include <algorithm>
+#include "shadow.h"
+#include "rendering.h"
+#include "scene.h"
+#include "shader.h"
+
+namespace rendering {
+
+namespace {
+
+// Shader for the depth passes, the z buffer is the only output that matters
+class DepthOnly : public shader::Shader {
+public:
+    DepthOnly(models::Model& model, std::vector<scene::PointLight>& lights, Eigen::Vector3d eye_pos)
+        : Shader(model, lights, eye_pos) {}
+
+    ppm_image::Pixel<float> compute_color(float, float, float) override {
+        return ppm_image::colors_f::BLACK;
+    }
+
+    void new_triangle(const Eigen::Vector3d&, const Eigen::Vector3d&, const Eigen::Vector3d&,
+        const Eigen::Vector3d&, const Eigen::Vector3d&, const Eigen::Vector3d&) override {}
+};
+
+// Camera orientation (axis, angle) looking down each cube face, the camera looks along -z by default
+const Eigen::Vector4d FACE_ORIENTATIONS[ShadowCubeMap::FACES] = {
+    {0, 1, 0, -M_PI / 2},   // +x
+    {0, 1, 0, M_PI / 2},    // -x
+    {1, 0, 0, M_PI / 2},    // +y
+    {1, 0, 0, -M_PI / 2},   // -y
+    {0, 1, 0, M_PI},        // +z
+    {0, 1, 0, 0},           // -z
+};
+
+} // namespace
+
+
+ShadowCubeMap::ShadowCubeMap(const Eigen::Vector3d& position, double near, double far, int resolution)
+    : position(position), near(near), far(far), resolution(resolution) {
+    for (int face = 0; face < FACES; face++)
+        depths[face] = Eigen::MatrixXd::Constant(resolution, resolution, far);
+}
+
+int ShadowCubeMap::face_of(const Eigen::Vector3d& direction) {
+    int axis;
+    direction.cwiseAbs().maxCoeff(&axis);
+    return 2 * axis + (direction(axis) < 0 ? 1 : 0);
+}
+
+void ShadowCubeMap::render(const std::vector<models::Model>& objects) {
+    std::vector<scene::PointLight> no_lights;
+    ppm_image::PPMImage<float> scratch(resolution, resolution, 1);
+
+    for (int face = 0; face < FACES; face++) {
+        // 90 degree frustum, the faces together cover every direction around the light exactly once
+        scene::Camera camera;
+        camera.position = position;
+        camera.orientation = FACE_ORIENTATIONS[face];
+        camera.n = near;
+        camera.f = far;
+        camera.l = -near;
+        camera.r = near;
+        camera.b = -near;
+        camera.t = near;
+        T_ndc[face] = camera.get_perspective_projection_matrix() * camera.get_transformation().inverse();
+
+        Eigen::MatrixXd z_buffer = Eigen::MatrixXd::Ones(resolution, resolution);
+        for (const auto& object : objects) {
+            DepthOnly depth_shader(const_cast<models::Model&>(object), no_lights, position);
+            render_object(scratch, object, camera, depth_shader, z_buffer);
+        }
+
+        depths[face] = z_buffer.unaryExpr([this](double ndc_z) { return linear_depth(ndc_z); });
+    }
+}
+
+double ShadowCubeMap::visibility(const Eigen::Vector3d& P, const Eigen::Vector3d& normal) const {
+    Eigen::Vector3d direction = P - position;
+    // Distance along the face axis, the same quantity the depth passes stored
+    double depth = direction.cwiseAbs().maxCoeff();
+    if (depth <= near || depth >= far)
+        return 1.0;
+
+    const int face = face_of(direction);
+    Eigen::Vector4d ndc_homo = T_ndc[face] * P.homogeneous();
+    double ndc_x = ndc_homo.x() / ndc_homo.w();
+    double ndc_y = ndc_homo.y() / ndc_homo.w();
+    // Same truncation as ndc_to_screen() in the depth passes
+    int tx = std::clamp(static_cast<int>((ndc_x + 1.0) / 2.0 * resolution), 0, resolution - 1);
+    int ty = std::clamp(static_cast<int>((ndc_y + 1.0) / 2.0 * resolution), 0, resolution - 1);
+
+    // Slope scaled bias: one texel covers 2 * depth / resolution world units and grows with the grazing angle
+    double cos_theta = std::abs(normal.dot(direction.normalized()));
+    double tan_theta = std::min(std::sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta)) / std::max(cos_theta, 1e-3), 10.0);
+    double bias = 2.0 * depth / resolution * (1.5 + tan_theta);
+
+    // Percentage closer filtering, texels past the face border are clamped to it
+    int lit = 0;
+    int total = 0;
+    for (int dy = -PCF_RADIUS; dy <= PCF_RADIUS; dy++) {
+        for (int dx = -PCF_RADIUS; dx <= PCF_RADIUS; dx++) {
+            int x = std::clamp(tx + dx, 0, resolution - 1);
+            int y = std::clamp(ty + dy, 0, resolution - 1);
+            if (depth - bias <= depths[face](y, x))
+                lit++;
+            total++;
+        }
+    }
+    return static_cast<double>(lit) / total;
+}
+
+} // namespace rendering
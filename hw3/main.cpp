@@ -2,21 +2,52 @@
 #include "scene.h"
 #include "opengl_handlers.h"
 #include "opengl_utils.h"
+#include "opengl_headless.h"
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " [scene_description_file.txt] [xres] [yres]" << std::endl;
+    const std::string usage = std::string("Usage: ") + argv[0] +
+        " [scene_description_file.txt] [xres] [yres] [--core] [--headless output_prefix] [--frames N] [--stats file.csv]";
+    if (argc < 4) {
+        std::cerr << usage << std::endl;
         return 1;
     }
 
+    bool core_profile = false;
+    std::string headless_prefix;
+    int frames = 1;
+    std::string stats_filename;
+    for (int i = 4; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--core") {
+            core_profile = true;
+        } else if (option == "--headless" && i + 1 < argc) {
+            headless_prefix = argv[++i];
+        } else if (option == "--frames" && i + 1 < argc) {
+            frames = std::stoi(argv[++i]);
+            if (frames < 1) {
+                std::cerr << "Error: --frames needs at least 1 frame" << std::endl;
+                return 1;
+            }
+        } else if (option == "--stats" && i + 1 < argc) {
+            stats_filename = argv[++i];
+        } else {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+    }
+
     std::string scene_filename = argv[1];
     
     // Create and load the scene
     scene::SceneFile scene(scene_filename);
     opengl_handlers::scene = &scene;
 
-    opengl_utils::init_window(argc, argv, std::stoi(argv[2]), std::stoi(argv[3]));
-    opengl_utils::start_scene_rendering(scene);
+    // No window: render the frames offscreen and write them, the core renderer draws them
+    if (!headless_prefix.empty())
+        return opengl_headless::render_frames(scene, std::stoi(argv[2]), std::stoi(argv[3]), headless_prefix, frames) ? 0 : 1;
+
+    opengl_utils::init_window(argc, argv, std::stoi(argv[2]), std::stoi(argv[3]), "OpenGL Scene", core_profile);
+    opengl_utils::start_scene_rendering(scene, stats_filename);
     
     return 0;
 }
@@ -0,0 +1,95 @@
+#include "include/camera_controller.h"
+#include "include/transformation.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace camera_controller {
+
+void CameraController::init(const scene::Camera& camera, int width, int height) {
+    eye_from_camera_view = camera.get_transformation().inverse();
+    near_plane = camera.n;
+    frustum_width = camera.r - camera.l;
+    frustum_height = camera.t - camera.b;
+    rotation = drag_rotation = Eigen::Quaterniond::Identity();
+    offset = drag_offset = Eigen::Vector3d::Zero();
+    dragging = Drag::NONE;
+    resize(width, height);
+    update();
+}
+
+void CameraController::resize(int width, int height) {
+    window_width = std::max(width, 1);
+    window_height = std::max(height, 1);
+}
+
+void CameraController::begin_rotate(int x, int y) {
+    end_drag();
+    dragging = Drag::ROTATE;
+    drag_x = x;
+    drag_y = y;
+}
+
+void CameraController::begin_pan(int x, int y) {
+    end_drag();
+    dragging = Drag::PAN;
+    drag_x = x;
+    drag_y = y;
+}
+
+bool CameraController::drag(int x, int y) {
+    if (dragging == Drag::ROTATE) {
+        Eigen::Vector3d start = ::transformation::screen_to_ndc_unit_sphere(drag_x, drag_y, window_width, window_height);
+        Eigen::Vector3d current = ::transformation::screen_to_ndc_unit_sphere(x, y, window_width, window_height);
+        Eigen::Quaterniond next = Eigen::Quaterniond::FromTwoVectors(start, current);
+        if (next.coeffs() == drag_rotation.coeffs())
+            return false;
+        drag_rotation = next;
+    } else if (dragging == Drag::PAN) {
+        // Eye space units per pixel at the depth of the world origin
+        double scale_x = frustum_width / window_width * pivot_depth() / near_plane;
+        double scale_y = frustum_height / window_height * pivot_depth() / near_plane;
+        Eigen::Vector3d next((x - drag_x) * scale_x, (drag_y - y) * scale_y, 0);
+        if (next == drag_offset)
+            return false;
+        drag_offset = next;
+    } else {
+        return false;
+    }
+    update();
+    return true;
+}
+
+void CameraController::end_drag() {
+    rotation = (drag_rotation * rotation).normalized();
+    offset += drag_offset;
+    drag_rotation = Eigen::Quaterniond::Identity();
+    drag_offset = Eigen::Vector3d::Zero();
+    dragging = Drag::NONE;
+}
+
+bool CameraController::zoom(int steps) {
+    double depth = pivot_depth();
+    double next = std::max(depth * std::pow(0.9, steps), near_plane);
+    if (next == depth)
+        return false;
+    offset.z() += depth - next;
+    update();
+    return true;
+}
+
+double CameraController::pivot_depth() const {
+    return std::max(-(eye_from_camera_view(2, 3) + offset.z() + drag_offset.z()), near_plane);
+}
+
+void CameraController::update() {
+    // The arcball turns the world about its origin, then the scene camera and the pan and zoom in eye space
+    Eigen::Matrix4d rotate = Eigen::Matrix4d::Identity();
+    rotate.block<3,3>(0,0) = (drag_rotation * rotation).toRotationMatrix();
+    Eigen::Matrix4d translate = Eigen::Matrix4d::Identity();
+    translate.block<3,1>(0,3) = offset + drag_offset;
+    view_cache = translate * eye_from_camera_view * rotate;
+    world_from_eye_cache = view_cache.inverse();
+}
+
+} // namespace camera_controller
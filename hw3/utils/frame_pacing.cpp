@@ -0,0 +1,133 @@
+#include "include/frame_pacing.h"
+
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace frame_pacing {
+
+void FrameScheduler::request() {
+    request_count++;
+    if (pending)
+        return;
+    pending = true;
+    pending_since = Clock::now();
+
+    // No frame yet, last_frame is min() and the difference below would overflow
+    if (last_frame == Clock::time_point::min()) {
+        post();
+        return;
+    }
+    auto since_last = pending_since - last_frame;
+    if (since_last >= interval) {
+        post();
+        return;
+    }
+    if (!timer_armed) {
+        timer_armed = true;
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(interval - since_last);
+        schedule(static_cast<unsigned int>(std::max<long long>(wait.count(), 1)));
+    }
+}
+
+void FrameScheduler::on_timer() {
+    timer_armed = false;
+    if (pending)
+        post();
+}
+
+Clock::time_point FrameScheduler::begin_frame() {
+    last_frame = Clock::now();
+    frame_count++;
+    Clock::time_point requested = pending ? pending_since : last_frame;
+    pending = false;
+    return requested;
+}
+
+void FrameStats::add(double draw_seconds, double latency_seconds) {
+    draw[next] = draw_seconds;
+    latency[next] = latency_seconds;
+    next = (next + 1) % HISTORY;
+    filled = std::min(filled + 1, HISTORY);
+}
+
+std::string FrameStats::summary() const {
+    if (filled == 0)
+        return "no frames";
+    double draw_sum = 0, draw_max = 0, latency_sum = 0;
+    for (std::size_t i = 0; i < filled; i++) {
+        draw_sum += draw[i];
+        draw_max = std::max(draw_max, draw[i]);
+        latency_sum += latency[i];
+    }
+    char text[96];
+    std::snprintf(text, sizeof(text), "draw %.1f ms (max %.1f), latency %.1f ms", 1e3 * draw_sum / filled,
+                  1e3 * draw_max, 1e3 * latency_sum / filled);
+    return text;
+}
+
+void draw_hud(const FrameStats& stats, const std::vector<std::string>& lines, int window_width, int window_height,
+              double interval_seconds, bool core_profile) {
+    const int margin = 8, bar_width = 2, pixels_per_ms = 2;
+    const int limit = static_cast<int>(std::lround(1e3 * interval_seconds * pixels_per_ms));
+    const int graph_height = std::min(2 * limit, window_height - 2 * margin);
+    const int graph_width = std::min(static_cast<int>(FrameStats::HISTORY) * bar_width, window_width - 2 * margin);
+    if (graph_height <= 0 || graph_width <= 0)
+        return;
+
+    GLfloat clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    glEnable(GL_SCISSOR_TEST);
+    auto fill = [](int x, int y, int width, int height, GLfloat r, GLfloat g, GLfloat b) {
+        glScissor(x, y, width, height);
+        glClearColor(r, g, b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    };
+
+    // Background, the refresh interval line, then the newest frame on the right
+    fill(margin, margin, graph_width, graph_height, 0.1f, 0.1f, 0.1f);
+    if (limit < graph_height)
+        fill(margin, margin + limit, graph_width, 1, 0.6f, 0.6f, 0.6f);
+    std::size_t bars = std::min(stats.count(), static_cast<std::size_t>(graph_width / bar_width));
+    for (std::size_t i = 0; i < bars; i++) {
+        double seconds = stats.draw_seconds(i);
+        int height = std::clamp(static_cast<int>(std::lround(1e3 * seconds * pixels_per_ms)), 1, graph_height);
+        int x = margin + graph_width - static_cast<int>(i + 1) * bar_width;
+        if (seconds <= interval_seconds)
+            fill(x, margin, bar_width - 1, height, 0.2f, 0.8f, 0.2f);
+        else
+            fill(x, margin, bar_width - 1, height, 0.9f, 0.2f, 0.2f);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+    // Bitmap text goes through the raster position, which only exists in compatibility contexts
+    if (core_profile)
+        return;
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(0);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, window_width, 0, window_height, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glColor3f(1.0f, 1.0f, 1.0f);
+    const int line_height = 16;
+    for (std::size_t i = 0; i < lines.size(); i++) {
+        glRasterPos2i(margin, margin + graph_height + 6 + line_height * static_cast<int>(lines.size() - 1 - i));
+        glutBitmapString(GLUT_BITMAP_HELVETICA_12, reinterpret_cast<const unsigned char*>(lines[i].c_str()));
+    }
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
+
+} // namespace frame_pacing
@@ -0,0 +1,81 @@
+#ifndef CAMERA_CONTROLLER_H
+#define CAMERA_CONTROLLER_H
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include "scene.h"
+
+// The interactive camera of the viewer: an arcball rotation about the world origin, zoom toward it and pan across
+// the view, applied on top of the scene camera. The view matrix and its inverse are only rebuilt when one of them
+// changes, so frames just read them.
+namespace camera_controller {
+
+    class CameraController {
+    public:
+        // Start from the scene camera in a window of the given size
+        void init(const scene::Camera& camera, int width, int height);
+
+        // The window size, updated from the reshape callback so motion events do not need to query GLUT
+        void resize(int width, int height);
+
+        int width() const {
+            return window_width;
+        }
+
+        int height() const {
+            return window_height;
+        }
+
+        // Left button drag: rotate by the arcball from the press point to the current one
+        void begin_rotate(int x, int y);
+        // Middle button drag: move the view so the point under the cursor at the depth of the world origin follows it
+        void begin_pan(int x, int y);
+        // Returns whether the view changed, motion that ends where the previous one did does not change it
+        bool drag(int x, int y);
+        // Keep the rotation or pan of the drag
+        void end_drag();
+
+        // Move toward the world origin by 10% of the distance per step, away from it for negative steps.
+        // Stops at the near plane. Returns whether the view changed.
+        bool zoom(int steps);
+
+        // World to eye
+        const Eigen::Matrix4d& view() const {
+            return view_cache;
+        }
+
+        // Eye to world
+        const Eigen::Matrix4d& world_from_eye() const {
+            return world_from_eye_cache;
+        }
+
+        Eigen::Vector3d eye_position() const {
+            return world_from_eye_cache.block<3,1>(0,3);
+        }
+
+    private:
+        enum class Drag { NONE, ROTATE, PAN };
+
+        // Distance from the eye to the plane through the world origin parallel to the image, at least the near plane
+        // so that zoom and pan keep their direction when the origin is behind the eye
+        double pivot_depth() const;
+        void update();
+
+        Eigen::Matrix4d eye_from_camera_view = Eigen::Matrix4d::Identity();    // the scene camera, inverted
+        double near_plane = 1, frustum_width = 1, frustum_height = 1;
+        int window_width = 1, window_height = 1;
+
+        Eigen::Quaterniond rotation = Eigen::Quaterniond::Identity();       // finished drags
+        Eigen::Quaterniond drag_rotation = Eigen::Quaterniond::Identity();  // the current drag
+        Eigen::Vector3d offset = Eigen::Vector3d::Zero();                   // pan and zoom, in eye space
+        Eigen::Vector3d drag_offset = Eigen::Vector3d::Zero();
+        Drag dragging = Drag::NONE;
+        int drag_x = 0, drag_y = 0;
+
+        Eigen::Matrix4d view_cache = Eigen::Matrix4d::Identity();
+        Eigen::Matrix4d world_from_eye_cache = Eigen::Matrix4d::Identity();
+    };
+
+} // namespace camera_controller
+
+#endif // CAMERA_CONTROLLER_H
@@ -0,0 +1,101 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Redraw on demand for the GLUT loop: input handlers request a frame instead of posting a redisplay, requests made
+// before the frame is drawn are coalesced into it, and frames start at most once per refresh interval. A small HUD
+// shows how long frames take and how late they are on screen after the input that caused them.
+namespace frame_pacing {
+
+    using Clock = std::chrono::steady_clock;
+
+    class FrameScheduler {
+    public:
+        // Callback that makes GLUT call display(), e.g. glutPostRedisplay
+        using PostRedisplay = void (*)();
+        // Callback that calls post() back after a delay in milliseconds, e.g. through glutTimerFunc
+        using Schedule = void (*)(unsigned int milliseconds);
+
+        // GLUT has no way to ask for the display refresh rate, 60 Hz is the common one
+        static constexpr double DEFAULT_INTERVAL = 1.0 / 60.0;
+
+        explicit FrameScheduler(PostRedisplay post, Schedule schedule, double interval_seconds = DEFAULT_INTERVAL)
+            : post(post), schedule(schedule), interval(interval_seconds) { }
+
+        // A frame is needed. Posts the redisplay right away when the last frame started at least one interval ago,
+        // otherwise schedules it for the end of the interval. Requests while one is pending only count as coalesced.
+        void request();
+
+        // The scheduled timer fired
+        void on_timer();
+
+        // display() started drawing, clears the pending request. Returns the time of the oldest request the frame
+        // answers, or now when it was not requested (window exposed or resized).
+        Clock::time_point begin_frame();
+
+        std::size_t requests() const {
+            return request_count;
+        }
+
+        std::size_t frames() const {
+            return frame_count;
+        }
+
+    private:
+        PostRedisplay post;
+        Schedule schedule;
+        std::chrono::duration<double> interval;
+        bool pending = false;
+        bool timer_armed = false;
+        Clock::time_point pending_since;
+        Clock::time_point last_frame = Clock::time_point::min();
+        std::size_t request_count = 0;
+        std::size_t frame_count = 0;
+    };
+
+    // Frame times of the last HISTORY frames
+    class FrameStats {
+    public:
+        static constexpr std::size_t HISTORY = 120;
+
+        /* @param draw_seconds: display() from its start to the return of the buffer swap
+            @param latency_seconds: from the oldest input the frame answers to the return of the buffer swap
+        */
+        void add(double draw_seconds, double latency_seconds);
+
+        // Most recent first, i from 0 to count() - 1
+        double draw_seconds(std::size_t i) const {
+            return draw[(next + HISTORY - 1 - i) % HISTORY];
+        }
+
+        std::size_t count() const {
+            return filled;
+        }
+
+        // "draw 4.1 ms (max 9.3), latency 12.0 ms" over the history
+        std::string summary() const;
+
+    private:
+        std::array<double, HISTORY> draw{};
+        std::array<double, HISTORY> latency{};
+        std::size_t next = 0;
+        std::size_t filled = 0;
+    };
+
+    /* Draw the HUD in the bottom left corner: one bar per recent frame, its height the draw time at 2 pixels per
+        millisecond, green when the frame fit in the refresh interval and red otherwise. The bars are scissored clears,
+        so they work in core and compatibility contexts alike. Compatibility contexts also get the lines of text above
+        the bars, the first one on top.
+        @param interval_seconds: refresh interval, drawn as the limit the bars are colored against
+    */
+    void draw_hud(const FrameStats& stats, const std::vector<std::string>& lines, int window_width, int window_height,
+                  double interval_seconds, bool core_profile);
+
+} // namespace frame_pacing
+
+#endif // FRAME_PACING_H
@@ -0,0 +1,111 @@
+#ifndef INSTANCE_BVH_H
+#define INSTANCE_BVH_H
+
+#include <array>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <Eigen/Dense>
+#include "models.h"
+
+
+namespace scene {
+
+    // Axis aligned bounding box, empty until a point is added
+    struct AABB {
+        Eigen::Vector3d min = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+        Eigen::Vector3d max = Eigen::Vector3d::Constant(-std::numeric_limits<double>::infinity());
+
+        void expand(const Eigen::Vector3d& point) {
+            min = min.cwiseMin(point);
+            max = max.cwiseMax(point);
+        }
+
+        void expand(const AABB& other) {
+            min = min.cwiseMin(other.min);
+            max = max.cwiseMax(other.max);
+        }
+
+        Eigen::Vector3d center() const {
+            return 0.5 * (min + max);
+        }
+
+        // Squared distance from a point to the closest point of the box, 0 inside it
+        double squared_distance(const Eigen::Vector3d& point) const {
+            return (point.cwiseMax(min).cwiseMin(max) - point).squaredNorm();
+        }
+
+        // Distance along the ray where it enters the box (0 when it starts inside), std::nullopt when it misses
+        std::optional<double> intersect(const Eigen::Vector3d& origin, const Eigen::Vector3d& inv_direction) const {
+            Eigen::Vector3d t0 = (min - origin).cwiseProduct(inv_direction);
+            Eigen::Vector3d t1 = (max - origin).cwiseProduct(inv_direction);
+            double t_enter = std::max(t0.cwiseMin(t1).maxCoeff(), 0.0);
+            double t_exit = t0.cwiseMax(t1).minCoeff();
+            if (t_enter > t_exit)
+                return std::nullopt;
+            return t_enter;
+        }
+    };
+
+    // World space box around an instance: the object space box of its obj file with the 8 corners transformed
+    AABB world_bounds(const models::Model& model);
+
+    // The six planes of a view frustum, extracted from a world to clip matrix. Normals point inside.
+    struct Frustum {
+        explicit Frustum(const Eigen::Matrix4d& clip_from_world);
+
+        // False only when the box is fully outside one of the planes, so a few boxes near the corners pass too
+        bool overlaps(const AABB& box) const;
+
+        std::array<Eigen::Vector4d, 6> planes;
+    };
+
+    // Bounding volume hierarchy over the instances of a scene, built from their world_bounds(). Queries only touch
+    // the nodes that overlap the query, so culling a scene costs time proportional to what is visible.
+    class InstanceBVH {
+    public:
+        // Instances per leaf
+        static constexpr int LEAF_SIZE = 2;
+
+        InstanceBVH() = default;
+        explicit InstanceBVH(const std::vector<models::Model>& objects);
+
+        /* Indices of the instances whose bounds overlap the frustum, ordered front to back by the distance from
+            the eye to their bounds, so near objects fill the depth buffer first and hide the fragments behind them
+        */
+        std::vector<std::size_t> visible(const Frustum& frustum, const Eigen::Vector3d& eye) const;
+
+        struct Hit {
+            std::size_t index;
+            double distance;
+        };
+
+        /* Instances whose bounds the ray passes through, ordered by the distance where it enters them, so a ray
+            query can test their triangles nearest first and stop at the first box behind its closest hit. The
+            direction does not need to be normalized, distance is in units of its length.
+        */
+        std::vector<Hit> along_ray(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction) const;
+
+        std::size_t size() const {
+            return instance_bounds.size();
+        }
+
+    private:
+        // Inner nodes keep their first child right after themselves and the second at first, leaves hold count
+        // instances starting at order[first]
+        struct Node {
+            AABB bounds;
+            std::size_t first = 0;
+            std::size_t count = 0;
+        };
+
+        std::size_t build(std::size_t begin, std::size_t end, const std::vector<Eigen::Vector3d>& centers);
+
+        std::vector<Node> nodes;
+        std::vector<std::size_t> order;
+        std::vector<AABB> instance_bounds;
+    };
+
+} // namespace scene
+
+#endif // INSTANCE_BVH_H
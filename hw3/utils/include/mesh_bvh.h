@@ -0,0 +1,71 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <Eigen/Dense>
+#include "models.h"
+
+
+namespace scene {
+
+    // Bounding volume hierarchy over the triangles of one obj file, in object space. It is built once per obj file
+    // and shared by all instances of it, rays are taken to object space instead of the triangles to world space.
+    //
+    // Nodes have 4 children whose boxes are stored as structure of arrays, so one ray is tested against the 4 boxes
+    // with a few 4-wide instructions. Leaves hold up to 4 triangles stored the same way and tested together.
+    class MeshBVH {
+    public:
+        static constexpr int WIDTH = 4;
+        using Lanes = Eigen::Array<float, WIDTH, 1>;
+
+        explicit MeshBVH(const models::ObjModel& obj);
+
+        struct Hit {
+            std::size_t face;       // index into ObjModel::faces
+            float u, v;             // barycentric coordinates of vertexes 1 and 2 of the face
+            float distance;         // in units of the direction length
+        };
+
+        // Closest triangle hit by the ray before t_max, both sides of the triangles count. The direction does not
+        // need to be normalized.
+        std::optional<Hit> raycast(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction,
+                                   float t_max = std::numeric_limits<float>::infinity()) const;
+
+        std::size_t triangle_count() const {
+            return triangles;
+        }
+
+    private:
+        // The first size children are used. Child c is the inner node nodes[child[c]] when count[c] is 0,
+        // otherwise the leaf leaves[child[c]] holding count[c] triangles.
+        struct Node {
+            Lanes min_x = Lanes::Zero(), min_y = Lanes::Zero(), min_z = Lanes::Zero();
+            Lanes max_x = Lanes::Zero(), max_y = Lanes::Zero(), max_z = Lanes::Zero();
+            std::array<std::uint32_t, WIDTH> child{};
+            std::array<std::uint32_t, WIDTH> count{};
+            int size = 0;
+        };
+
+        // Up to 4 triangles as a vertex and two edges per lane, unused lanes are degenerate and never hit
+        struct Leaf {
+            Lanes v0_x = Lanes::Zero(), v0_y = Lanes::Zero(), v0_z = Lanes::Zero();
+            Lanes e1_x = Lanes::Zero(), e1_y = Lanes::Zero(), e1_z = Lanes::Zero();
+            Lanes e2_x = Lanes::Zero(), e2_y = Lanes::Zero(), e2_z = Lanes::Zero();
+            std::array<std::uint32_t, WIDTH> face{};
+        };
+
+        struct Build;
+        void build(std::uint32_t node, std::size_t begin, std::size_t end, Build& state);
+
+        std::vector<Node> nodes;
+        std::vector<Leaf> leaves;
+        std::size_t triangles = 0;
+    };
+
+} // namespace scene
+
+#endif // MESH_BVH_H
@@ -6,6 +6,7 @@
 #include <utility>
 #include <string>
 #include <array>
+#include <cstdint>
 #include <variant>
 #include <memory>
 #include <optional>
@@ -15,6 +16,18 @@
 // These model classes are only containers providing data storage, io and type conversions, transformation logic should be implemented elsewhere
 namespace models{
 
+// Interleaved vertex for GPU upload: the position and an octahedral encoded normal, 16 bytes instead of the 24 of
+// two Vector3f
+struct PackedVertex {
+    GLfloat position[3];
+    GLshort normal[2];      // signed normalized, decode with decode_octahedral()
+};
+
+// Unit normal folded onto the octahedron |x| + |y| + |z| = 1 and flattened to its xy, lower hemisphere folded over
+// the diagonals, quantized to 16 bits per component. Zero normals encode as +z.
+std::array<GLshort, 2> encode_octahedral(const Eigen::Vector3f& normal);
+Eigen::Vector3f decode_octahedral(const std::array<GLshort, 2>& encoded);
+
 // Object file class that stores the vertexes and faces, and support laoding from .obj file by calling load_from_obj_file()
 struct ObjModel {
 
@@ -66,6 +79,17 @@ struct ObjModel {
         return M;
     }
     
+    // Vertexes and normals interleaved as PackedVertex, missing normals encode as +z
+    std::vector<PackedVertex> export_packed_vertexes() const;
+
+    // Whether every vertex index fits the 16 bit index type
+    bool short_indices_compatible() const {
+        return vertexes.size() < 65536;
+    }
+
+    // faces_opengl as 16 bit indices, only valid when short_indices_compatible()
+    std::vector<GLushort> export_short_indices() const;
+
     void load_vertexes_from_homo_matrix(Eigen::Matrix4Xd& matrix) {
         vertexes.clear();
         const int cols = static_cast<int>(matrix.cols());
@@ -84,6 +108,8 @@ struct ObjModel {
     vertexList normals;
     FaceList faces;
     std::vector<FaceOpenGL> faces_opengl;
+    Eigen::Vector3d bound_min = Eigen::Vector3d::Zero();    // object space bounding box, built in load_from_obj_file()
+    Eigen::Vector3d bound_max = Eigen::Vector3d::Zero();
     std::string filename;
     bool drawElement_compatible;
 };
@@ -0,0 +1,65 @@
+#ifndef OPENGL_CORE_H
+#define OPENGL_CORE_H
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include <Eigen/Dense>
+#include "scene.h"
+
+// Core profile renderer: every obj file is uploaded once, in the compact models::PackedVertex format, into vertex
+// and index buffers inside a vertex array object, and the objects are shaded per fragment by GLSL with the
+// Blinn-Phong model of hw2 rendering::lighting(). Nothing here touches GLUT or the fixed function state, so it draws
+// into any OpenGL 3.3 core context, a window or an offscreen one.
+namespace opengl_core {
+
+    class CoreRenderer {
+    public:
+        // Lights past this many are ignored
+        static constexpr int MAX_LIGHTS = 8;
+
+        CoreRenderer() = default;
+        ~CoreRenderer();
+        CoreRenderer(const CoreRenderer&) = delete;
+        CoreRenderer& operator=(const CoreRenderer&) = delete;
+
+        // Build the shaders and upload the obj files of the scene, needs a current context.
+        // Returns false when the shaders do not build.
+        bool init(const scene::SceneFile& scene);
+
+        /* Draw the objects with one instanced call per obj file, the caller clears the buffers.
+            @param indices: objects to draw, e.g. InstanceBVH::visible()
+            @param view: world to eye, e.g. opengl_handlers::helpers::view_matrix()
+            @param selected: object drawn with the emissive highlight
+        */
+        void draw(const scene::SceneFile& scene, const std::vector<std::size_t>& indices, const Eigen::Matrix4d& view,
+                  std::optional<std::size_t> selected = std::nullopt);
+
+    private:
+        // Buffers of one obj file: interleaved models::PackedVertex, and 16 bit indices when the vertexes allow it.
+        // Drawn with glDrawElements when it has an index buffer, glDrawArrays otherwise.
+        struct Mesh {
+            GLuint vertex_array = 0;
+            GLuint vertexes = 0;
+            GLuint indices = 0;
+            GLenum index_type = GL_UNSIGNED_INT;
+            GLsizei count = 0;      // indices, or vertexes without an index buffer
+        };
+
+        void upload(const models::ObjModel& obj);
+
+        GLuint program = 0;
+        GLuint instance_buffer = 0;
+        GLint view_projection_location = -1;
+        GLint eye_position_location = -1;
+        GLint light_count_location = -1;
+        GLint light_position_location = -1;
+        GLint light_color_location = -1;
+        GLint light_k_location = -1;
+        std::unordered_map<const models::ObjModel*, Mesh> meshes;
+    };
+
+} // namespace opengl_core
+
+#endif // OPENGL_CORE_H
@@ -1,28 +1,67 @@
 #ifndef OPENGL_HANDLERS_H
 #define OPENGL_HANDLERS_H
 
+#include <optional>
+
 // Forward declarations
 namespace scene {
     class Scene;
 }
+namespace opengl_core {
+    class CoreRenderer;
+}
+namespace render_stats {
+    class FrameProfiler;
+}
+namespace render_queue {
+    class RenderQueue;
+}
+namespace camera_controller {
+    class CameraController;
+}
 
 namespace opengl_handlers {
     // Global scene pointer, needs to be manually point to the scene object to be rendered
     extern scene::SceneFile* scene;
+    // Draw the copies of each obj file with one instanced call (opengl_instancing.h) instead of one call per object,
+    // turned on by start_scene_rendering() when the context supports it
+    extern bool instancing;
+    // Draws everything in a core profile context, nullptr for the fixed function paths
+    extern opengl_core::CoreRenderer* core_renderer;
+    // Draws the objects when neither instancing nor the core renderer does, set by start_scene_rendering()
+    extern render_queue::RenderQueue* draw_queue;
+    // Times the draw calls of every frame and counts what they submit, shown in the HUD
+    extern render_stats::FrameProfiler* profiler;
+    // Rotation, pan and zoom of the view, initialized by start_scene_rendering()
+    extern camera_controller::CameraController camera;
+    // Draw the frame time HUD (frame_pacing.h), toggled with the h key
+    extern bool show_hud;
     
     // Helper functions
     namespace helpers {
+        // World to eye matrix of the camera controller, rebuilt only on input
+        const Eigen::Matrix4d& view_matrix();
+        // Load the view into the modelview matrix, once per frame
         void camera_transform();
-        Eigen::Matrix4d compute_rotation_quaternion(int x, int y, int p_start_x, int p_start_y);
         void set_lights();
+        // Object and triangle under the window pixel (x, y)
+        std::optional<scene::SceneFile::RayHit> pick_object(int x, int y);
         void draw_objects();
     }
     
     // Main GLUT callback functions:
     void display(void);
     void window_resize(int width, int height);
+    // The window is closing while its context is still current, the pending frame times are collected
+    void window_closed();
+    // Left button drags rotate the scene, middle button drags pan it, the wheel zooms, the right button selects the
+    // object under the cursor
     void mouse_pressed(int button, int state, int x, int y);
+    // Drags only request a frame (frame_pacing::FrameScheduler) when the view changed, by a rotation or a pan, so a
+    // burst of motion events is drawn once per refresh interval
     void mouse_motion(int x, int y);
+    // h toggles the HUD, i switches between instanced and sorted fixed function drawing
+    void key_pressed(unsigned char key, int x, int y);
 }
 
 #endif // OPENGL_HANDLERS_H
@@ -0,0 +1,31 @@
+#ifndef OPENGL_HEADLESS_H
+#define OPENGL_HEADLESS_H
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "scene.h"
+
+// Rendering without a window or display: an EGL context on Mesa's surfaceless platform (or the default EGL display)
+// draws with opengl_core::CoreRenderer into a framebuffer object, and frames are read back asynchronously through
+// pixel buffer objects and written as binary PPM files.
+namespace opengl_headless {
+
+    // Write 8 bit RGBA rows, bottom row first as glReadPixels returns them, as a binary (P6) PPM file.
+    // Returns false if the file can not be written.
+    bool write_ppm(const std::string& filename, const GLubyte* rgba, int width, int height);
+
+    // File name of one frame, <prefix>_0007.ppm like hw2 batch mode
+    std::string frame_filename(const std::string& prefix, int frame);
+
+    /* Render frames of the scene turning around the world y axis, a full turn over all frames (frame 0 is the scene
+        camera view), and write each one to frame_filename(prefix, i). The read back of frame i goes to a pixel buffer
+        object while frame i + 1 renders, and is only mapped and written after that, so the GPU never waits for the
+        file writes. Times are printed to stderr.
+        @return false if no context could be created or a frame could not be written
+    */
+    bool render_frames(const scene::SceneFile& scene, int width, int height, const std::string& prefix, int frames = 1);
+
+} // namespace opengl_headless
+
+#endif // OPENGL_HEADLESS_H
@@ -0,0 +1,44 @@
+#ifndef OPENGL_INSTANCING_H
+#define OPENGL_INSTANCING_H
+
+#include <optional>
+#include <vector>
+#include <GL/glew.h>
+#include <Eigen/Dense>
+#include "scene.h"
+
+// Instanced drawing of the objects that share an obj file: one draw call per obj file, with the transform and
+// material of every copy read from a per instance vertex buffer. A small shader reproduces the fixed function
+// Gouraud lighting from the same glLight state, so both paths produce the same image.
+namespace opengl_instancing {
+
+    // Objects sharing an obj file, in the order they were given
+    struct InstanceGroup {
+        const models::ObjModel* obj_file;
+        std::vector<std::size_t> instances;
+    };
+
+    // Group objects by obj file, groups are ordered by their first object so a front to back order is kept
+    std::vector<InstanceGroup> group_by_obj_file(const std::vector<models::Model>& objects,
+                                                 const std::vector<std::size_t>& indices);
+
+    // Build the shader for the first light_count GL lights (at most 8) and the instance buffer, needs a current
+    // context. Returns false when the context lacks OpenGL 3.3 or the shader does not build, draw_objects() must
+    // not be called then.
+    bool init(int light_count);
+
+    // Whether init() succeeded
+    bool ready();
+
+    /* Draw the objects with one instanced call per obj file, vertexes and normals still come from the client arrays.
+        The modelview matrix must hold the camera transform and the lights must already be set like for the fixed
+        function path.
+        @param indices: objects to draw, e.g. InstanceBVH::visible()
+        @param selected: object drawn with the emissive highlight
+    */
+    void draw_objects(const scene::SceneFile& scene, const std::vector<std::size_t>& indices,
+                      std::optional<std::size_t> selected);
+
+} // namespace opengl_instancing
+
+#endif // OPENGL_INSTANCING_H
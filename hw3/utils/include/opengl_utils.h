@@ -1,14 +1,20 @@
 #ifndef OPENGL_UTILS_H
 #define OPENGL_UTILS_H
 #include <string>
+#include <utility>
+#include <vector>
+#include <GL/glew.h>
 #include "scene.h"
 #include "opengl_handlers.h"
 
 /* Some utility functions to interact with OpenGL and setup the scene*/
 namespace opengl_utils {
-    // The functions to be called in order to start the scene rendering
-    void init_window(int argc, char* argv[], int xres = 1280, int yres = 720, std::string window_name = "OpenGL Scene");
-    void start_scene_rendering(scene::SceneFile& scene = (*opengl_handlers::scene));
+    // The functions to be called in order to start the scene rendering. A core profile window is drawn by
+    // opengl_core::CoreRenderer, the default compatibility one by the fixed function or instancing paths.
+    void init_window(int argc, char* argv[], int xres = 1280, int yres = 720, std::string window_name = "OpenGL Scene",
+                     bool core_profile = false);
+    // With a stats_csv file name, the times and counters of every frame (render_stats.h) are written to it.
+    void start_scene_rendering(scene::SceneFile& scene = (*opengl_handlers::scene), const std::string& stats_csv = "");
 
     // Tow helper functions to called in start_scene_rendering
     void init_lights(scene::SceneFile& scene);
@@ -16,6 +22,14 @@ namespace opengl_utils {
 
     // Print the OpenGL modelview matrix at the instance it is called for debugging
     void print_model_matrices();
+
+    // Compile one shader stage, prints the log and returns 0 on failure
+    GLuint compile_shader(GLenum type, const std::string& source);
+
+    // Link a program from compiled stages, which are deleted, binding the given attribute names to locations first.
+    // Prints the log and returns 0 on failure.
+    GLuint link_program(GLuint vertex, GLuint fragment,
+                        const std::vector<std::pair<GLuint, const char*>>& attribute_locations = {});
 }
 
 #endif // OPENGL_UTILS_H
@@ -0,0 +1,59 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+#include <GL/glew.h>
+#include <Eigen/Dense>
+#include "scene.h"
+
+// Fixed function drawing sorted to change as little GL state as possible: the visible objects are drawn grouped by
+// obj file, and within an obj file by material, so the client array pointers are only set when the obj file changes
+// and the glMaterial calls only when the material does.
+namespace render_queue {
+
+    class RenderQueue {
+    public:
+        // Number the obj files and build the material blocks of the scene objects, objects with equal materials
+        // share one. Both are snapshots of the scene: call init() again after changing a material or an obj file.
+        void init(const scene::SceneFile& scene);
+
+        /* Draw the objects with the fixed function pipeline, lights must already be set.
+            @param indices: objects to draw, e.g. InstanceBVH::visible(). Objects sharing an obj file and a material
+                keep this order, so a front to back order still helps the depth test within them.
+            @param view: world to eye, each object is drawn with glLoadMatrixd(view * transform)
+            @param selected: object drawn with the emissive highlight
+        */
+        void draw(const scene::SceneFile& scene, const std::vector<std::size_t>& indices, const Eigen::Matrix4d& view,
+                  std::optional<std::size_t> selected = std::nullopt);
+
+    private:
+        // The glMaterial parameters of an object, ready to pass
+        struct Material {
+            GLfloat ambient[4];
+            GLfloat diffuse[4];
+            GLfloat specular[4];
+            GLfloat shininess;
+
+            bool operator==(const Material& other) const;
+        };
+
+        struct DrawItem {
+            std::size_t mesh;
+            std::size_t material;
+            const models::ObjModel* obj_file;
+            std::size_t index;
+        };
+
+        void set_material(const Material& material);
+
+        std::vector<Material> materials;
+        std::vector<std::size_t> object_materials;  // material of each scene object
+        std::vector<std::size_t> object_meshes;     // obj file of each scene object, numbered in scene order
+        std::vector<DrawItem> items;                // reused from frame to frame
+    };
+
+} // namespace render_queue
+
+#endif // RENDER_QUEUE_H
@@ -0,0 +1,96 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <GL/glew.h>
+
+// Where a frame of the viewer goes: the draw paths count what they submit in render_stats::counters, and a
+// FrameProfiler times each frame on the CPU and, with GL_TIME_ELAPSED queries, on the GPU. A submission time close
+// to the GPU time means the CPU keeps the GPU busy, a much smaller one that the GPU is the bottleneck.
+namespace render_stats {
+
+    // What one frame submitted
+    struct Counters {
+        std::size_t draw_calls = 0;
+        std::size_t state_changes = 0;      // GL calls that set state between draws: matrices, materials, bindings,
+                                            // attribute pointers and uniforms
+        std::size_t triangles = 0;          // counting every instance
+    };
+
+    // Incremented by the draw paths, reset by FrameProfiler::begin_frame()
+    extern Counters counters;
+
+    inline void count_draw(std::size_t triangles, std::size_t instances = 1) {
+        counters.draw_calls++;
+        counters.triangles += triangles * instances;
+    }
+
+    inline void count_state_changes(std::size_t n = 1) {
+        counters.state_changes += n;
+    }
+
+    // Counters and times of a finished frame
+    struct FrameRecord {
+        std::size_t frame = 0;
+        Counters counters;
+        double cpu_ms = 0;      // from begin_frame() to end_frame(), the submission of the draw calls
+        double gpu_ms = -1;     // from the GPU timer query, -1 until its result is available or without timer queries
+    };
+
+    /* Frame timing that never waits for the GPU. Two GL_TIME_ELAPSED queries take turns: while one measures the
+        current frame, the other holds the previous frame and its result is only read once
+        GL_QUERY_RESULT_AVAILABLE says so, one frame late. A frame whose result is still not there when its query
+        is needed again is recorded without a GPU time.
+    */
+    class FrameProfiler {
+    public:
+        FrameProfiler() = default;
+        ~FrameProfiler();
+        FrameProfiler(const FrameProfiler&) = delete;
+        FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+        /* Create the queries, needs a current context. Without timer queries (before OpenGL 3.3) only the CPU side
+            is measured.
+            @param csv_filename: write one line per frame to this file, none if empty
+            @return false if the CSV file can not be opened
+        */
+        bool init(const std::string& csv_filename = "");
+
+        // Around the draw calls of one frame, the time queries can not be nested so only one profiler may be active
+        void begin_frame();
+        void end_frame();
+
+        // Record the frames whose queries are still pending, waiting for their GPU times. Needs the context, so call
+        // it before the context goes away, e.g. when the window closes. The destructor calls it too.
+        void finish();
+
+        // Latest recorded frame, usually the one before the current one
+        const FrameRecord& latest() const {
+            return last_complete;
+        }
+
+        // "gpu 3.1 ms, cpu 0.4 ms, 12 draws, 96 state changes, 1.2M triangles"
+        std::string summary() const;
+
+    private:
+        // Record the frame in the slot if it is pending, with its GPU time if the query result is available
+        void collect(std::size_t slot, bool only_if_available);
+        void record(const FrameRecord& frame);
+
+        bool timer_queries = false;
+        std::array<GLuint, 2> queries = {0, 0};
+        std::array<FrameRecord, 2> frames;     // frame i in slot i % 2, with its query
+        std::array<bool, 2> pending = {false, false};
+        std::size_t frame_count = 0;
+        std::chrono::steady_clock::time_point start;
+        FrameRecord last_complete;
+        std::ofstream csv;
+    };
+
+} // namespace render_stats
+
+#endif // RENDER_STATS_H
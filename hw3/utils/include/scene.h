@@ -11,6 +11,8 @@
 
 #include "transformation.h"
 #include "models.h"
+#include "instance_bvh.h"
+#include "mesh_bvh.h"
 
 namespace scene {
 
@@ -207,6 +209,7 @@ public:
                 }
                 
                 object_files.emplace(label, std::make_pair(obj_data, 1));
+                mesh_bvhs.emplace(obj_data.get(), MeshBVH(*obj_data));
             } else if (state == States::WAIT_SECTION) {
             } else if (state == States::NEW_SECTION) {
                 std::string new_label;
@@ -231,6 +234,8 @@ public:
         if (state == States::GETTING_TRANSFORM)
             objects.emplace_back(std::move(current_model));
 
+        instance_bvh = InstanceBVH(objects);
+
         // if (apply_camera_transform)
         //     transform_to_camera_frame();
     }
@@ -241,10 +246,45 @@ public:
     //     }
     // }
 
+    struct RayHit {
+        std::size_t instance;   // index into objects
+        std::size_t face;       // index into the faces of its obj file
+        double u, v;            // barycentric coordinates of vertexes 1 and 2 of the face
+        double distance;        // in units of the direction length
+    };
+
+    /* Closest triangle of any object hit by a world space ray. The instance hierarchy gives the objects whose
+        bounds the ray crosses, nearest first, and the ray is taken to the object space of each one and cast through
+        the triangle hierarchy of its obj file, until the next bounds start behind the closest hit.
+    */
+    std::optional<RayHit> raycast(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction) const {
+        std::optional<RayHit> best;
+        for (const InstanceBVH::Hit& candidate : instance_bvh.along_ray(origin, direction)) {
+            if (best && candidate.distance > best->distance)
+                break;
+            const models::Model& object = objects[candidate.index];
+            auto mesh = mesh_bvhs.find(object.obj_file.get());
+            if (mesh == mesh_bvhs.end())
+                continue;
+            // An affine transform keeps the ray parameter, so the object space distance is the world one
+            Eigen::Matrix4d object_from_world = object.transform.inverse();
+            Eigen::Vector3f local_origin = (object_from_world.block<3,3>(0,0) * origin + object_from_world.block<3,1>(0,3)).cast<float>();
+            Eigen::Vector3f local_direction = (object_from_world.block<3,3>(0,0) * direction).cast<float>();
+            float t_max = best ? static_cast<float>(best->distance) : std::numeric_limits<float>::infinity();
+            if (std::optional<MeshBVH::Hit> hit = mesh->second.raycast(local_origin, local_direction, t_max))
+                best = RayHit{candidate.index, hit->face, hit->u, hit->v, hit->distance};
+        }
+        return best;
+    }
+
     Camera camera;
     std::vector<models::Model> objects;
     std::string scene_path;
     std::vector<PointLight> lights;
+    // Hierarchy over the world bounds of the objects for culling and picking, rebuild it after editing objects
+    InstanceBVH instance_bvh;
+    // Triangle hierarchy of each obj file, shared by its instances
+    std::unordered_map<const models::ObjModel*, MeshBVH> mesh_bvhs;
 
 private:
     States state;
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cmath>
+#include "instance_bvh.h"
+
+namespace scene {
+
+AABB world_bounds(const models::Model& model) {
+    const Eigen::Vector3d& lo = model.obj_file->bound_min;
+    const Eigen::Vector3d& hi = model.obj_file->bound_max;
+    AABB box;
+    for (int corner = 0; corner < 8; corner++) {
+        Eigen::Vector4d p((corner & 1) ? hi.x() : lo.x(), (corner & 2) ? hi.y() : lo.y(), (corner & 4) ? hi.z() : lo.z(), 1.0);
+        box.expand((model.transform * p).head<3>());
+    }
+    return box;
+}
+
+Frustum::Frustum(const Eigen::Matrix4d& clip_from_world) {
+    // -w <= x, y, z <= w in clip space, each inequality is a plane in world space
+    const Eigen::RowVector4d w = clip_from_world.row(3);
+    for (int axis = 0; axis < 3; axis++) {
+        planes[2 * axis] = (w + clip_from_world.row(axis)).transpose();
+        planes[2 * axis + 1] = (w - clip_from_world.row(axis)).transpose();
+    }
+}
+
+bool Frustum::overlaps(const AABB& box) const {
+    for (const auto& plane : planes) {
+        // The corner furthest along the plane normal
+        Eigen::Vector3d corner = (plane.head<3>().array() >= 0).select(box.max, box.min);
+        if (plane.head<3>().dot(corner) + plane.w() < 0)
+            return false;
+    }
+    return true;
+}
+
+InstanceBVH::InstanceBVH(const std::vector<models::Model>& objects) {
+    if (objects.empty())
+        return;
+    std::vector<Eigen::Vector3d> centers;
+    centers.reserve(objects.size());
+    instance_bounds.reserve(objects.size());
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        instance_bounds.push_back(world_bounds(objects[i]));
+        centers.push_back(instance_bounds.back().center());
+        order.push_back(i);
+    }
+    nodes.reserve(2 * objects.size());
+    build(0, objects.size(), centers);
+}
+
+std::size_t InstanceBVH::build(std::size_t begin, std::size_t end, const std::vector<Eigen::Vector3d>& centers) {
+    const std::size_t index = nodes.size();
+    nodes.emplace_back();
+    AABB bounds, center_bounds;
+    for (std::size_t i = begin; i < end; i++) {
+        bounds.expand(instance_bounds[order[i]]);
+        center_bounds.expand(centers[order[i]]);
+    }
+    nodes[index].bounds = bounds;
+
+    if (end - begin <= static_cast<std::size_t>(LEAF_SIZE)) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return index;
+    }
+
+    // Median split along the axis where the centers spread the most
+    int axis;
+    (center_bounds.max - center_bounds.min).maxCoeff(&axis);
+    std::size_t middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                     [&](std::size_t a, std::size_t b) { return centers[a](axis) < centers[b](axis); });
+
+    build(begin, middle, centers);
+    std::size_t second = build(middle, end, centers);
+    nodes[index].first = second;
+    return index;
+}
+
+std::vector<std::size_t> InstanceBVH::visible(const Frustum& frustum, const Eigen::Vector3d& eye) const {
+    std::vector<std::size_t> result;
+    if (nodes.empty())
+        return result;
+
+    std::vector<std::size_t> stack = {0};
+    while (!stack.empty()) {
+        const std::size_t index = stack.back();
+        const Node& node = nodes[index];
+        stack.pop_back();
+        if (!frustum.overlaps(node.bounds))
+            continue;
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(index + 1);
+            continue;
+        }
+        for (std::size_t i = node.first; i < node.first + node.count; i++) {
+            if (node.count == 1 || frustum.overlaps(instance_bounds[order[i]]))
+                result.push_back(order[i]);
+        }
+    }
+
+    // Ties keep the scene order, so the image does not depend on the shape of the tree
+    std::vector<std::pair<double, std::size_t>> by_distance;
+    by_distance.reserve(result.size());
+    for (std::size_t i : result)
+        by_distance.emplace_back(instance_bounds[i].squared_distance(eye), i);
+    std::sort(by_distance.begin(), by_distance.end());
+    for (std::size_t i = 0; i < result.size(); i++)
+        result[i] = by_distance[i].second;
+    return result;
+}
+
+std::vector<InstanceBVH::Hit> InstanceBVH::along_ray(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction) const {
+    std::vector<Hit> result;
+    if (nodes.empty())
+        return result;
+
+    // Axis aligned rays would give inf, and 0 * inf = NaN on a box face, as in MeshBVH::raycast()
+    Eigen::Vector3d inv_direction;
+    for (int axis = 0; axis < 3; axis++) {
+        double d = direction(axis);
+        inv_direction(axis) = 1.0 / (std::abs(d) > 1e-20 ? d : std::copysign(1e-20, d));
+    }
+    std::vector<std::size_t> stack = {0};
+    while (!stack.empty()) {
+        const std::size_t index = stack.back();
+        const Node& node = nodes[index];
+        stack.pop_back();
+        if (!node.bounds.intersect(origin, inv_direction))
+            continue;
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(index + 1);
+            continue;
+        }
+        for (std::size_t i = node.first; i < node.first + node.count; i++) {
+            if (std::optional<double> t = instance_bounds[order[i]].intersect(origin, inv_direction))
+                result.push_back(Hit{order[i], *t});
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const Hit& a, const Hit& b) { return a.distance < b.distance; });
+    return result;
+}
+
+} // namespace scene
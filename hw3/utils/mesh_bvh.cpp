@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+#include "mesh_bvh.h"
+
+namespace scene {
+
+// Triangles of the obj file and their order while building
+struct MeshBVH::Build {
+    std::vector<std::array<Eigen::Vector3f, 3>> corners;
+    std::vector<Eigen::Vector3f> centers;
+    std::vector<std::uint32_t> order;
+
+    void bounds(std::size_t begin, std::size_t end, Eigen::Vector3f& lo, Eigen::Vector3f& hi) const {
+        lo = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity());
+        hi = -lo;
+        for (std::size_t i = begin; i < end; i++) {
+            for (const auto& corner : corners[order[i]]) {
+                lo = lo.cwiseMin(corner);
+                hi = hi.cwiseMax(corner);
+            }
+        }
+    }
+
+    // Median split along the axis where the centers spread the most, returns the middle
+    std::size_t split(std::size_t begin, std::size_t end) {
+        Eigen::Vector3f lo = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity());
+        Eigen::Vector3f hi = -lo;
+        for (std::size_t i = begin; i < end; i++) {
+            lo = lo.cwiseMin(centers[order[i]]);
+            hi = hi.cwiseMax(centers[order[i]]);
+        }
+        int axis;
+        (hi - lo).maxCoeff(&axis);
+        std::size_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](std::uint32_t a, std::uint32_t b) { return centers[a](axis) < centers[b](axis); });
+        return middle;
+    }
+};
+
+MeshBVH::MeshBVH(const models::ObjModel& obj) {
+    Build state;
+    triangles = obj.faces.size();
+    state.corners.reserve(triangles);
+    state.centers.reserve(triangles);
+    for (std::size_t f = 0; f < triangles; f++) {
+        std::array<Eigen::Vector3f, 3> corners;
+        for (int i = 0; i < 3; i++) {
+            // Files that are not drawElement_compatible have their vertexes unrolled to 3 per face
+            std::size_t vertex = obj.drawElement_compatible ? obj.faces[f][i] : 3 * f + i;
+            corners[i] = obj.vertexes[vertex];
+        }
+        state.corners.push_back(corners);
+        state.centers.push_back((corners[0] + corners[1] + corners[2]) / 3.0f);
+        state.order.push_back(static_cast<std::uint32_t>(f));
+    }
+    if (triangles == 0)
+        return;
+
+    nodes.reserve(triangles / 2 + 1);
+    leaves.reserve(triangles / 2 + 1);
+    nodes.emplace_back();
+    build(0, 0, triangles, state);
+}
+
+void MeshBVH::build(std::uint32_t node, std::size_t begin, std::size_t end, Build& state) {
+    // Split the range in halves until there are 4 parts or every part fits in a leaf
+    std::vector<std::pair<std::size_t, std::size_t>> parts = {{begin, end}};
+    while (parts.size() < WIDTH) {
+        auto largest = std::max_element(parts.begin(), parts.end(), [](const auto& a, const auto& b) {
+            return a.second - a.first < b.second - b.first;
+        });
+        if (largest->second - largest->first <= static_cast<std::size_t>(WIDTH))
+            break;
+        std::pair<std::size_t, std::size_t> part = *largest;
+        std::size_t middle = state.split(part.first, part.second);
+        *largest = {part.first, middle};
+        parts.emplace_back(middle, part.second);
+    }
+
+    for (std::size_t c = 0; c < parts.size(); c++) {
+        const auto [first, last] = parts[c];
+        Eigen::Vector3f lo, hi;
+        state.bounds(first, last, lo, hi);
+        Node& slot = nodes[node];
+        slot.min_x(c) = lo.x(); slot.min_y(c) = lo.y(); slot.min_z(c) = lo.z();
+        slot.max_x(c) = hi.x(); slot.max_y(c) = hi.y(); slot.max_z(c) = hi.z();
+        slot.size = static_cast<int>(c) + 1;
+
+        if (last - first <= static_cast<std::size_t>(WIDTH)) {
+            Leaf leaf;
+            for (std::size_t i = first; i < last; i++) {
+                const std::size_t lane = i - first;
+                const auto& corners = state.corners[state.order[i]];
+                Eigen::Vector3f e1 = corners[1] - corners[0], e2 = corners[2] - corners[0];
+                leaf.v0_x(lane) = corners[0].x(); leaf.v0_y(lane) = corners[0].y(); leaf.v0_z(lane) = corners[0].z();
+                leaf.e1_x(lane) = e1.x(); leaf.e1_y(lane) = e1.y(); leaf.e1_z(lane) = e1.z();
+                leaf.e2_x(lane) = e2.x(); leaf.e2_y(lane) = e2.y(); leaf.e2_z(lane) = e2.z();
+                leaf.face[lane] = state.order[i];
+            }
+            slot.child[c] = static_cast<std::uint32_t>(leaves.size());
+            slot.count[c] = static_cast<std::uint32_t>(last - first);
+            leaves.push_back(leaf);
+        } else {
+            // emplace_back can move the nodes, so slot is not used past this point
+            std::uint32_t child = static_cast<std::uint32_t>(nodes.size());
+            slot.child[c] = child;
+            slot.count[c] = 0;
+            nodes.emplace_back();
+            build(child, first, last, state);
+        }
+    }
+}
+
+std::optional<MeshBVH::Hit> MeshBVH::raycast(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float t_max) const {
+    std::optional<Hit> best;
+    if (nodes.empty())
+        return best;
+
+    // Zero components get a tiny stand in, so the slab distances stay finite instead of 0 * inf
+    Eigen::Vector3f inv_direction;
+    for (int axis = 0; axis < 3; axis++) {
+        float d = direction(axis);
+        inv_direction(axis) = 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+    }
+    const Lanes ox = Lanes::Constant(origin.x()), oy = Lanes::Constant(origin.y()), oz = Lanes::Constant(origin.z());
+    const Lanes dx = Lanes::Constant(direction.x()), dy = Lanes::Constant(direction.y()), dz = Lanes::Constant(direction.z());
+
+    // Nodes still to visit with the distance where the ray enters them. Every level pushes at most 3 more nodes
+    // than it pops and the median splits keep the depth under 32.
+    struct Entry {
+        std::uint32_t node;
+        float t;
+    };
+    std::array<Entry, 3 * 32 + 1> stack;
+    int top = 0;
+    stack[top++] = {0, 0.0f};
+
+    while (top > 0) {
+        const Entry entry = stack[--top];
+        if (entry.t > t_max)
+            continue;
+        const Node& node = nodes[entry.node];
+
+        // Slab test of the 4 children at once
+        Lanes t0 = (node.min_x - ox) * inv_direction.x(), t1 = (node.max_x - ox) * inv_direction.x();
+        Lanes t_enter = t0.min(t1), t_exit = t0.max(t1);
+        t0 = (node.min_y - oy) * inv_direction.y(); t1 = (node.max_y - oy) * inv_direction.y();
+        t_enter = t_enter.max(t0.min(t1)); t_exit = t_exit.min(t0.max(t1));
+        t0 = (node.min_z - oz) * inv_direction.z(); t1 = (node.max_z - oz) * inv_direction.z();
+        t_enter = t_enter.max(t0.min(t1)).max(0.0f); t_exit = t_exit.min(t0.max(t1)).min(t_max);
+
+        // Children hit, the leaves are intersected right away and the inner nodes pushed far to near
+        std::array<Entry, WIDTH> inner;
+        int inner_count = 0;
+        for (int c = 0; c < node.size; c++) {
+            if (!(t_enter(c) <= t_exit(c)))
+                continue;
+            if (node.count[c] == 0) {
+                inner[inner_count++] = {node.child[c], t_enter(c)};
+                continue;
+            }
+
+            // Moller-Trumbore on the 4 triangles of the leaf
+            const Leaf& leaf = leaves[node.child[c]];
+            Lanes px = dy * leaf.e2_z - dz * leaf.e2_y;
+            Lanes py = dz * leaf.e2_x - dx * leaf.e2_z;
+            Lanes pz = dx * leaf.e2_y - dy * leaf.e2_x;
+            Lanes det = leaf.e1_x * px + leaf.e1_y * py + leaf.e1_z * pz;
+            Lanes inv_det = det.inverse();
+            Lanes sx = ox - leaf.v0_x, sy = oy - leaf.v0_y, sz = oz - leaf.v0_z;
+            Lanes u = (sx * px + sy * py + sz * pz) * inv_det;
+            Lanes qx = sy * leaf.e1_z - sz * leaf.e1_y;
+            Lanes qy = sz * leaf.e1_x - sx * leaf.e1_z;
+            Lanes qz = sx * leaf.e1_y - sy * leaf.e1_x;
+            Lanes v = (dx * qx + dy * qy + dz * qz) * inv_det;
+            Lanes t = (leaf.e2_x * qx + leaf.e2_y * qy + leaf.e2_z * qz) * inv_det;
+            // Degenerate triangles and unused lanes have det 0, their u, v, t are not finite and fail the tests
+            auto hit = (det != 0.0f) && (u >= 0.0f) && (v >= 0.0f) && (u + v <= 1.0f) && (t >= 0.0f) && (t <= t_max);
+            for (std::uint32_t lane = 0; lane < node.count[c]; lane++) {
+                if (hit(lane) && t(lane) <= t_max) {
+                    t_max = t(lane);
+                    best = Hit{leaf.face[lane], u(lane), v(lane), t(lane)};
+                }
+            }
+        }
+        std::sort(inner.begin(), inner.begin() + inner_count, [](const Entry& a, const Entry& b) { return a.t > b.t; });
+        for (int i = 0; i < inner_count; i++)
+            stack[top++] = inner[i];
+    }
+    return best;
+}
+
+} // namespace scene
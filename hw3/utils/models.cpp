@@ -3,6 +3,8 @@
 #include <sstream>
 #include <iostream>
 #include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
 
 
 namespace models {
@@ -106,8 +108,60 @@ bool ObjModel::load_from_obj_file(const std::string& filename) {
         vertexes = std::move(new_vertexes);
         normals = std::move(new_normals);
     }
+
+    if (!vertexes.empty()) {
+        bound_min = bound_max = vertexes.front().cast<double>();
+        for (const auto& vertex : vertexes) {
+            bound_min = bound_min.cwiseMin(vertex.cast<double>());
+            bound_max = bound_max.cwiseMax(vertex.cast<double>());
+        }
+    }
     
     return true;
 }
 
+std::array<GLshort, 2> encode_octahedral(const Eigen::Vector3f& normal) {
+    float l1 = normal.cwiseAbs().sum();
+    if (l1 == 0.0f)
+        return {0, 0};
+    Eigen::Vector3f n = normal / l1;
+    Eigen::Vector2f e = n.head<2>();
+    if (n.z() < 0.0f) {
+        e.x() = (1.0f - std::abs(n.y())) * (n.x() >= 0.0f ? 1.0f : -1.0f);
+        e.y() = (1.0f - std::abs(n.x())) * (n.y() >= 0.0f ? 1.0f : -1.0f);
+    }
+    return {static_cast<GLshort>(std::lround(std::clamp(e.x(), -1.0f, 1.0f) * 32767.0f)),
+            static_cast<GLshort>(std::lround(std::clamp(e.y(), -1.0f, 1.0f) * 32767.0f))};
+}
+
+Eigen::Vector3f decode_octahedral(const std::array<GLshort, 2>& encoded) {
+    Eigen::Vector3f n(std::max(encoded[0] / 32767.0f, -1.0f), std::max(encoded[1] / 32767.0f, -1.0f), 0.0f);
+    n.z() = 1.0f - std::abs(n.x()) - std::abs(n.y());
+    float t = std::max(-n.z(), 0.0f);
+    n.x() += n.x() >= 0.0f ? -t : t;
+    n.y() += n.y() >= 0.0f ? -t : t;
+    return n.normalized();
+}
+
+std::vector<PackedVertex> ObjModel::export_packed_vertexes() const {
+    std::vector<PackedVertex> packed(vertexes.size());
+    for (std::size_t i = 0; i < vertexes.size(); i++) {
+        Eigen::Map<Eigen::Vector3f>(packed[i].position) = vertexes[i];
+        std::array<GLshort, 2> normal = encode_octahedral(i < normals.size() ? normals[i] : Eigen::Vector3f::Zero());
+        packed[i].normal[0] = normal[0];
+        packed[i].normal[1] = normal[1];
+    }
+    return packed;
+}
+
+std::vector<GLushort> ObjModel::export_short_indices() const {
+    std::vector<GLushort> indices;
+    indices.reserve(3 * faces_opengl.size());
+    for (const auto& face : faces_opengl) {
+        for (GLuint index : face)
+            indices.push_back(static_cast<GLushort>(index));
+    }
+    return indices;
+}
+
 } // namespace models
\ No newline at end of file
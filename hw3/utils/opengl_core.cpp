@@ -0,0 +1,281 @@
+#include "include/opengl_core.h"
+#include "include/opengl_instancing.h"
+#include "include/opengl_utils.h"
+#include "include/render_stats.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+namespace opengl_core {
+
+namespace {
+
+constexpr GLuint POSITION_LOCATION = 0;
+constexpr GLuint NORMAL_LOCATION = 1;
+constexpr GLuint MODEL_LOCATION = 2;            // mat4, 4 locations
+constexpr GLuint NORMAL_MATRIX_LOCATION = 6;    // mat3, 3 locations
+constexpr GLuint AMBIENT_LOCATION = 9;
+constexpr GLuint DIFFUSE_LOCATION = 10;
+constexpr GLuint SPECULAR_LOCATION = 11;
+constexpr GLuint EMISSION_LOCATION = 12;
+constexpr GLuint SHININESS_LOCATION = 13;
+
+// Vertexes go to world space, where the lights are, materials pass through flat
+const char* VERTEX_SHADER = R"(
+#version 330 core
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 octahedral_normal;
+layout(location = 2) in mat4 model;
+layout(location = 6) in mat3 normal_matrix;
+layout(location = 9) in vec3 ambient;
+layout(location = 10) in vec3 diffuse;
+layout(location = 11) in vec3 specular;
+layout(location = 12) in vec3 emission;
+layout(location = 13) in float shininess;
+
+uniform mat4 view_projection;
+
+// models::decode_octahedral()
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+out vec3 world_position;
+out vec3 world_normal;
+flat out vec3 material_ambient;
+flat out vec3 material_diffuse;
+flat out vec3 material_specular;
+flat out vec3 material_emission;
+flat out float material_shininess;
+
+void main() {
+    vec4 world = model * vec4(position, 1.0);
+    world_position = world.xyz;
+    world_normal = normal_matrix * decode_octahedral(octahedral_normal);
+    material_ambient = ambient;
+    material_diffuse = diffuse;
+    material_specular = specular;
+    material_emission = emission;
+    material_shininess = shininess;
+    gl_Position = view_projection * world;
+}
+)";
+
+// rendering::lighting() of hw2 per fragment: ambient, plus diffuse and Blinn-Phong specular of every light
+// attenuated by 1 / (1 + k d^2), clamped to 1
+const char* FRAGMENT_SHADER = R"(
+#version 330 core
+const int MAX_LIGHTS = 8;
+
+uniform vec3 eye_position;
+uniform int light_count;
+uniform vec3 light_position[MAX_LIGHTS];
+uniform vec3 light_color[MAX_LIGHTS];
+uniform float light_k[MAX_LIGHTS];
+
+in vec3 world_position;
+in vec3 world_normal;
+flat in vec3 material_ambient;
+flat in vec3 material_diffuse;
+flat in vec3 material_specular;
+flat in vec3 material_emission;
+flat in float material_shininess;
+
+out vec4 frag_color;
+
+void main() {
+    vec3 n = normalize(world_normal);
+    vec3 e = normalize(eye_position - world_position);
+    vec3 diffuse_sum = vec3(0.0);
+    vec3 specular_sum = vec3(0.0);
+    for (int i = 0; i < light_count; i++) {
+        vec3 to_light = light_position[i] - world_position;
+        float distance_squared = dot(to_light, to_light);
+        vec3 l = distance_squared > 0.0 ? to_light * inversesqrt(distance_squared) : vec3(0.0);
+        float attenuation = 1.0 / (1.0 + light_k[i] * distance_squared);
+        float n_dot_l = dot(n, l);
+        if (n_dot_l > 0.0)
+            diffuse_sum += light_color[i] * n_dot_l * attenuation;
+        // As rendering::lighting(), shininess 0 lights even where n.h is 0. GLSL leaves pow(0, 0) undefined.
+        float n_dot_h = max(dot(n, normalize(e + l)), 0.0);
+        if (n_dot_h > 0.0 || material_shininess <= 0.0)
+            specular_sum += light_color[i] * (n_dot_h > 0.0 ? pow(n_dot_h, material_shininess) : 1.0) * attenuation;
+    }
+    vec3 color = material_ambient + diffuse_sum * material_diffuse + specular_sum * material_specular + material_emission;
+    frag_color = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
+)";
+
+// One element of the instance buffer
+struct InstanceData {
+    GLfloat model[16];
+    GLfloat normal_matrix[9];
+    GLfloat ambient[3];
+    GLfloat diffuse[3];
+    GLfloat specular[3];
+    GLfloat emission[3];
+    GLfloat shininess;
+};
+
+void set_instance_attribute(GLuint location, GLint size, std::size_t offset) {
+    glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<const void*>(offset));
+    render_stats::count_state_changes();
+}
+
+} // namespace
+
+CoreRenderer::~CoreRenderer() {
+    for (auto& [obj, mesh] : meshes) {
+        glDeleteVertexArrays(1, &mesh.vertex_array);
+        GLuint buffers[] = {mesh.vertexes, mesh.indices};
+        glDeleteBuffers(2, buffers);
+    }
+    glDeleteBuffers(1, &instance_buffer);
+    glDeleteProgram(program);
+}
+
+bool CoreRenderer::init(const scene::SceneFile& scene) {
+    program = opengl_utils::link_program(opengl_utils::compile_shader(GL_VERTEX_SHADER, VERTEX_SHADER),
+                                         opengl_utils::compile_shader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER));
+    if (!program)
+        return false;
+    view_projection_location = glGetUniformLocation(program, "view_projection");
+    eye_position_location = glGetUniformLocation(program, "eye_position");
+    light_count_location = glGetUniformLocation(program, "light_count");
+    light_position_location = glGetUniformLocation(program, "light_position");
+    light_color_location = glGetUniformLocation(program, "light_color");
+    light_k_location = glGetUniformLocation(program, "light_k");
+
+    glGenBuffers(1, &instance_buffer);
+    for (const auto& object : scene.objects) {
+        if (object.obj_file && !meshes.count(object.obj_file.get()))
+            upload(*object.obj_file);
+    }
+    return true;
+}
+
+void CoreRenderer::upload(const models::ObjModel& obj) {
+    Mesh& mesh = meshes[&obj];
+    glGenVertexArrays(1, &mesh.vertex_array);
+    glBindVertexArray(mesh.vertex_array);
+
+    std::vector<models::PackedVertex> vertexes = obj.export_packed_vertexes();
+    glGenBuffers(1, &mesh.vertexes);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexes);
+    glBufferData(GL_ARRAY_BUFFER, vertexes.size() * sizeof(models::PackedVertex), vertexes.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(models::PackedVertex),
+                          reinterpret_cast<const void*>(offsetof(models::PackedVertex, position)));
+    glEnableVertexAttribArray(NORMAL_LOCATION);
+    glVertexAttribPointer(NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE, sizeof(models::PackedVertex),
+                          reinterpret_cast<const void*>(offsetof(models::PackedVertex, normal)));
+
+    if (obj.drawElement_compatible) {
+        glGenBuffers(1, &mesh.indices);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indices);
+        if (obj.short_indices_compatible()) {
+            std::vector<GLushort> indices = obj.export_short_indices();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+            mesh.index_type = GL_UNSIGNED_SHORT;
+        } else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, obj.faces_opengl.size() * sizeof(models::ObjModel::FaceOpenGL),
+                         obj.faces_opengl.data(), GL_STATIC_DRAW);
+            mesh.index_type = GL_UNSIGNED_INT;
+        }
+        mesh.count = static_cast<GLsizei>(3 * obj.faces_opengl.size());
+    } else {
+        mesh.count = static_cast<GLsizei>(obj.vertexes.size());
+    }
+
+    // The per instance attributes read the shared instance buffer, their offsets are set for every draw
+    for (GLuint location = MODEL_LOCATION; location <= SHININESS_LOCATION; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CoreRenderer::draw(const scene::SceneFile& scene, const std::vector<std::size_t>& indices, const Eigen::Matrix4d& view,
+                        std::optional<std::size_t> selected) {
+    std::vector<opengl_instancing::InstanceGroup> groups = opengl_instancing::group_by_obj_file(scene.objects, indices);
+
+    std::vector<InstanceData> instances;
+    instances.reserve(indices.size());
+    for (const auto& group : groups) {
+        for (std::size_t index : group.instances) {
+            const models::Model& model = scene.objects[index];
+            InstanceData data;
+            Eigen::Map<Eigen::Matrix4f>(data.model) = model.transform.cast<float>();
+            Eigen::Map<Eigen::Matrix3f>(data.normal_matrix) = model.transform.block<3,3>(0,0).inverse().transpose().cast<float>();
+            Eigen::Map<Eigen::Vector3f>(data.ambient) = model.ambient;
+            Eigen::Map<Eigen::Vector3f>(data.diffuse) = model.diffuse;
+            Eigen::Map<Eigen::Vector3f>(data.specular) = model.specular;
+            Eigen::Map<Eigen::Vector3f>(data.emission) = selected == index ? Eigen::Vector3f(0.3f, 0.3f, 0.0f) : Eigen::Vector3f::Zero();
+            data.shininess = model.shininess;
+            instances.push_back(data);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STREAM_DRAW);
+
+    glUseProgram(program);
+    Eigen::Matrix4f view_projection = (scene.camera.get_perspective_projection_matrix() * view).cast<float>();
+    Eigen::Vector3f eye = view.inverse().block<3,1>(0,3).cast<float>();
+    glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, view_projection.data());
+    glUniform3fv(eye_position_location, 1, eye.data());
+
+    const int light_count = std::min<int>(static_cast<int>(scene.lights.size()), MAX_LIGHTS);
+    GLfloat positions[3 * MAX_LIGHTS], colors[3 * MAX_LIGHTS], k[MAX_LIGHTS];
+    for (int i = 0; i < light_count; i++) {
+        Eigen::Map<Eigen::Vector3f>(positions + 3 * i) = scene.lights[i].position;
+        Eigen::Map<Eigen::Vector3f>(colors + 3 * i) = scene.lights[i].color;
+        k[i] = scene.lights[i].k;
+    }
+    glUniform1i(light_count_location, light_count);
+    glUniform3fv(light_position_location, light_count, positions);
+    glUniform3fv(light_color_location, light_count, colors);
+    glUniform1fv(light_k_location, light_count, k);
+    render_stats::count_state_changes(9);
+
+    std::size_t first = 0;
+    for (const auto& group : groups) {
+        auto it = meshes.find(group.obj_file);
+        if (it == meshes.end()) {
+            first += group.instances.size();
+            continue;
+        }
+        const Mesh& mesh = it->second;
+        glBindVertexArray(mesh.vertex_array);
+        render_stats::count_state_changes();
+        const std::size_t base = first * sizeof(InstanceData);
+        for (int column = 0; column < 4; column++)
+            set_instance_attribute(MODEL_LOCATION + column, 4, base + offsetof(InstanceData, model) + 4 * column * sizeof(GLfloat));
+        for (int column = 0; column < 3; column++)
+            set_instance_attribute(NORMAL_MATRIX_LOCATION + column, 3, base + offsetof(InstanceData, normal_matrix) + 3 * column * sizeof(GLfloat));
+        set_instance_attribute(AMBIENT_LOCATION, 3, base + offsetof(InstanceData, ambient));
+        set_instance_attribute(DIFFUSE_LOCATION, 3, base + offsetof(InstanceData, diffuse));
+        set_instance_attribute(SPECULAR_LOCATION, 3, base + offsetof(InstanceData, specular));
+        set_instance_attribute(EMISSION_LOCATION, 3, base + offsetof(InstanceData, emission));
+        set_instance_attribute(SHININESS_LOCATION, 1, base + offsetof(InstanceData, shininess));
+
+        const GLsizei count = static_cast<GLsizei>(group.instances.size());
+        if (mesh.indices)
+            glDrawElementsInstanced(GL_TRIANGLES, mesh.count, mesh.index_type, nullptr, count);
+        else
+            glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.count, count);
+        render_stats::count_draw(mesh.count / 3, count);
+        first += group.instances.size();
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+} // namespace opengl_core
@@ -5,8 +5,17 @@
 #include "include/scene.h"
 #include "include/models.h"
 #include "iostream"
+#include <chrono>
+#include <cstdio>
 #include <iomanip>
+#include <optional>
 #include "include/transformation.h"
+#include "include/opengl_instancing.h"
+#include "include/opengl_core.h"
+#include "include/frame_pacing.h"
+#include "include/render_stats.h"
+#include "include/render_queue.h"
+#include "include/camera_controller.h"
 
 // forward declaration
 namespace opengl_utils {
@@ -16,54 +25,34 @@ namespace opengl_utils {
 
 namespace opengl_handlers {
     scene::SceneFile* scene;
-    static Eigen::Vector4d last_rotation_quat = Eigen::Vector4d(0, 0, 0, 1);  // Identity quaternion (x,y,z,w)
-    static Eigen::Vector4d current_rotation_quat = Eigen::Vector4d(0, 0, 0, 1);  // Identity quaternion (x,y,z,w)
-    static int p_start_x, p_start_y;
-    static bool is_pressed = false;
+    bool instancing = false;
+    opengl_core::CoreRenderer* core_renderer = nullptr;
+    render_stats::FrameProfiler* profiler = nullptr;
+    render_queue::RenderQueue* draw_queue = nullptr;
+    camera_controller::CameraController camera;
+    static std::optional<std::size_t> selected;     // object picked with the right button, drawn highlighted
+    bool show_hud = false;
+    // One redraw per refresh interval at most, however many input events arrive in between
+    static frame_pacing::FrameScheduler scheduler(glutPostRedisplay, [](unsigned int milliseconds) {
+        glutTimerFunc(milliseconds, [](int) { scheduler.on_timer(); }, 0);
+    });
+    static frame_pacing::FrameStats frame_stats;
+    // GLUT reports the mouse wheel as two more buttons
+    constexpr int WHEEL_UP = 3;
+    constexpr int WHEEL_DOWN = 4;
 
 
 namespace helpers {
 
 
 
-void camera_transform() {
-    // First, apply the the initial camera transformation
-    const auto& camera = scene->camera;
-    glLoadIdentity();
-    glRotatef(-camera.orientation(3) * 180.0 / M_PI, camera.orientation(0), camera.orientation(1), camera.orientation(2));
-    glTranslatef(-camera.position.x(), -camera.position.y(), -camera.position.z());
-
-    // Then, apply the current rotation quaternion
-    Eigen::Vector4d combined_quat = ::transformation::quaternion_multiply(current_rotation_quat, last_rotation_quat);
-    Eigen::Matrix4d rotation_matrix = ::transformation::get_martix_4x4_from_quaternion(combined_quat);
-    glMultMatrixd(rotation_matrix.data());
+const Eigen::Matrix4d& view_matrix() {
+    return camera.view();
 }
 
-Eigen::Vector4d compute_rotation_quaternion(int x, int y, int p_start_x, int p_start_y) {
-    // Get window dimensions
-    int width = glutGet(GLUT_WINDOW_WIDTH);
-    int height = glutGet(GLUT_WINDOW_HEIGHT);
-    
-    Eigen::Vector3d current_ndc = transformation::screen_to_ndc_unit_sphere(x, y, width, height);
-    Eigen::Vector3d start_ndc = transformation::screen_to_ndc_unit_sphere(p_start_x, p_start_y, width, height);
-    
-    // Compute rotation quaternion from two unit vectors
-    Eigen::Vector3d rotation_axis = start_ndc.cross(current_ndc);
-    double rotation_angle = std::acos(std::min(1.0, start_ndc.dot(current_ndc)));
-    
-    rotation_axis.normalize();
-    
-    double half_angle = rotation_angle * 0.5;
-    double s = std::sin(half_angle);
-    double c = std::cos(half_angle);
-    
-    Eigen::Vector4d quaternion;
-    quaternion(0) = rotation_axis.x() * s;  // x
-    quaternion(1) = rotation_axis.y() * s;  // y  
-    quaternion(2) = rotation_axis.z() * s;  // z
-    quaternion(3) = c;                     // w (scalar)
-    
-    return quaternion;
+void camera_transform() {
+    glLoadMatrixd(camera.view().data());
+    render_stats::count_state_changes();
 }
 
 void set_lights() {
@@ -72,77 +61,80 @@ void set_lights() {
         glLightfv(light_id, GL_POSITION, light.position.data());
         light_id++;
     }
+    render_stats::count_state_changes(scene->lights.size());
+}
+
+std::optional<scene::SceneFile::RayHit> pick_object(int x, int y) {
+    int width = camera.width();
+    int height = camera.height();
+    const auto& frustum = scene->camera;
+
+    // Ray from the eye through the pixel center on the near plane, taken back to world space
+    Eigen::Vector3d direction(frustum.l + (frustum.r - frustum.l) * (x + 0.5) / width,
+                              frustum.t - (frustum.t - frustum.b) * (y + 0.5) / height, -frustum.n);
+    const Eigen::Matrix4d& world_from_eye = camera.world_from_eye();
+    return scene->raycast(world_from_eye.block<3,1>(0,3), world_from_eye.block<3,3>(0,0) * direction);
 }
 
 void draw_objects() {
-    for (const auto& model : scene->objects) {
-        glPushMatrix(); {
-            // Don't know why but openGL supposingly use post-multiplication for matrices,
-            // but doing this transpose generates the incorrect result?!
-            // Eigen::Matrix4d transposed_transform = model.transform.transpose();
-            glMultMatrixd(model.transform.data());
-
-            // glLoadIdentity();
-            // Eigen::Matrix4d hardcoded_matrix;
-            // // hardcoded_matrix << 1.0, 0.0, 0.0, 0.4,
-            // //                     0.0, 1.0, 0.0, -0.9,
-            // //                     0.0, 0.0, 1.0, -4.0,
-            // //                     0.0, 0.0, 0.0, 1.0;
-            // hardcoded_matrix <<  1.0222 , -0.3592 , 0.7184 , 0.9330, 
-            //                   0.3592 , 1.2444 , 0.1111 , -0.8319,
-            //                   -0.7184 , 0.1111 , 1.0778 , -5.5361,
-            //                   0.0000 , 0.0000 , 0.0000 , 1.0000;
-            // // hardcoded_matrix <<  0.853588 ,  0.146412 , 0.499951 , 0,
-            // //                    0.146412 , 0.853588 , -0.499951 , 0,
-            // //                    -0.499951 , 0.499951 , 0.707176 , -5,
-            // //                    0 , 0 , 0 , 1;
-            // // hardcoded_matrix = hardcoded_matrix.transpose();
-            // glMultMatrixd(hardcoded_matrix.data());
-            
-            // Set material properties
-            glMaterialfv(GL_FRONT, GL_AMBIENT, model.ambient.data());
-            glMaterialfv(GL_FRONT, GL_DIFFUSE, model.diffuse.data());
-            glMaterialfv(GL_FRONT, GL_SPECULAR, model.specular.data());
-            glMaterialf(GL_FRONT, GL_SHININESS, model.shininess);
-            
-            // std::cout << "Model: " << model.name << std::endl;
-            // std::cout << "Model Transform Matrix (camera frame):" << std::endl;
-            // std::cout << scene->camera.get_transformation().inverse()*(model.transform) << std::endl;
-            // opengl_utils::print_model_matrices();
-            
-            // Set vertex and normal pointers
-            glVertexPointer(3, GL_FLOAT, sizeof(Eigen::Vector3f), model.obj_file->vertexes.data());
-            glNormalPointer(GL_FLOAT, sizeof(Eigen::Vector3f), model.obj_file->normals.data());
-            
-            // glDrawArrays(GL_TRIANGLES, 0, model.obj_file->vertexes.size());
-            // glDrawArrays(GL_LINE_STRIP, 0, model.obj_file->vertexes.size());
-            // glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, model.obj_file->faces_opengl.data());
-            
-            // Draw the model using the appropriate method
-            if (model.obj_file->drawElement_compatible) {
-            // If the vertexes and normal indices are the same for each face, DrawElements could be used
-                // std::cout << "Drawing model: " << model.name << " with DrawElements" << std::endl;
-                glDrawElements(GL_TRIANGLES, 3*model.obj_file->faces_opengl.size(), GL_UNSIGNED_INT, model.obj_file->faces_opengl.data());
-            } else {
-                // std::cout << "Drawing model: " << model.name << " with drawArrays" << std::endl;
-                glDrawArrays(GL_TRIANGLES, 0, model.obj_file->vertexes.size());
-            }
-
-            // std::cout << "Drawing model: " << model.name << std::endl;
-        } glPopMatrix();
+    // Only the objects in the view frustum, nearest first so the depth test rejects more fragments
+    const Eigen::Matrix4d& view = view_matrix();
+    scene::Frustum frustum(scene->camera.get_perspective_projection_matrix() * view);
+    Eigen::Vector3d eye = camera.eye_position();
+
+    std::vector<std::size_t> visible = scene->instance_bvh.visible(frustum, eye);
+    if (core_renderer) {
+        core_renderer->draw(*scene, visible, view, selected);
+        return;
+    }
+    if (instancing) {
+        opengl_instancing::draw_objects(*scene, visible, selected);
+        return;
     }
+
+    draw_queue->draw(*scene, visible, view, selected);
 }
 } // namespace helpers
 
 void display(void) {
+    frame_pacing::Clock::time_point requested = scheduler.begin_frame();
+    frame_pacing::Clock::time_point start = frame_pacing::Clock::now();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    helpers::set_lights();
-    glMatrixMode(GL_MODELVIEW);
-    helpers::camera_transform();
+    // Before the camera and lights, they are state changes of the frame too
+    if (profiler)
+        profiler->begin_frame();
+
+    // The core renderer takes the lights and camera as uniforms, there is no fixed function state to set.
+    // The light positions are transformed by the modelview matrix when they are set, so the view goes first.
+    if (!core_renderer) {
+        glMatrixMode(GL_MODELVIEW);
+        helpers::camera_transform();
+        helpers::set_lights();
+    }
     helpers::draw_objects();
-    
+    if (profiler)
+        profiler->end_frame();
+
+    if (show_hud) {
+        char counts[64];
+        std::snprintf(counts, sizeof(counts), ", %zu frames for %zu requests", scheduler.frames(), scheduler.requests());
+        std::vector<std::string> lines = {frame_stats.summary() + counts};
+        if (profiler)
+            lines.push_back(profiler->summary());
+        frame_pacing::draw_hud(frame_stats, lines, camera.width(), camera.height(),
+                               frame_pacing::FrameScheduler::DEFAULT_INTERVAL, core_renderer != nullptr);
+        // No bitmap text in core contexts, the summary goes to the title bar a few times a second
+        if (core_renderer && scheduler.frames() % 15 == 0) {
+            std::string title = lines[0];
+            for (std::size_t i = 1; i < lines.size(); i++)
+                title += " | " + lines[i];
+            glutSetWindowTitle(title.c_str());
+        }
+    }
+
     glutSwapBuffers();
+    frame_pacing::Clock::time_point end = frame_pacing::Clock::now();
+    frame_stats.add(std::chrono::duration<double>(end - start).count(), std::chrono::duration<double>(end - requested).count());
 }
 
 void window_resize(int width, int height) {
@@ -150,31 +142,60 @@ void window_resize(int width, int height) {
     width = (width == 0) ? 1 : width;
     
     glViewport(0, 0, width, height);
+    camera.resize(width, height);
     
-    glutPostRedisplay();
+    scheduler.request();
+}
+
+void window_closed() {
+    if (profiler)
+        profiler->finish();
 }
 
 
 void mouse_pressed(int button, int state, int x, int y) {
     if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
-        p_start_x = x;
-        p_start_y = y;
-        is_pressed = true;
-        // std::cout << "Mouse pressed at: " << x << ", " << y << std::endl;
+        camera.begin_rotate(x, y);
+    }
+    else if(button == GLUT_MIDDLE_BUTTON && state == GLUT_DOWN) {
+        camera.begin_pan(x, y);
+    }
+    else if((button == GLUT_LEFT_BUTTON || button == GLUT_MIDDLE_BUTTON) && state == GLUT_UP) {
+        camera.end_drag();
     }
-    else if(button == GLUT_LEFT_BUTTON && state == GLUT_UP) {
-        is_pressed = false;
-        last_rotation_quat = ::transformation::quaternion_multiply(current_rotation_quat, last_rotation_quat);
-        current_rotation_quat = Eigen::Vector4d(0, 0, 0, 1);  // Reset to identity quaternion
+    else if((button == WHEEL_UP || button == WHEEL_DOWN) && state == GLUT_DOWN) {
+        if (camera.zoom(button == WHEEL_UP ? 1 : -1))
+            scheduler.request();
+    }
+    else if(button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN) {
+        std::optional<scene::SceneFile::RayHit> hit = helpers::pick_object(x, y);
+        selected = hit ? std::optional<std::size_t>(hit->instance) : std::nullopt;
+        if (hit)
+            std::cout << "Selected " << scene->objects[hit->instance].name << " face " << hit->face
+                      << " (u " << hit->u << ", v " << hit->v << ")" << std::endl;
+        else
+            std::cout << "Selected nothing" << std::endl;
+        scheduler.request();
     }
 }
 
 
 void mouse_motion(int x, int y) {
-    if (is_pressed) {
-        // std::cout << "Mouse dragging at: " << x << ", " << y << std::endl;
-        current_rotation_quat = helpers::compute_rotation_quaternion(x, y, p_start_x, p_start_y);
-        glutPostRedisplay();  
+    // Motion that does not move the camera, e.g. back to the press point, needs no frame
+    if (camera.drag(x, y))
+        scheduler.request();
+}
+
+void key_pressed(unsigned char key, int, int) {
+    if (key == 'i' && !core_renderer) {
+        instancing = !instancing && opengl_instancing::ready();
+        std::cout << (instancing ? "Instanced drawing" : "Sorted fixed function drawing") << std::endl;
+        scheduler.request();
+    } else if (key == 'h') {
+        show_hud = !show_hud;
+        if (!show_hud && core_renderer)
+            glutSetWindowTitle("OpenGL Scene");
+        scheduler.request();
     }
 }
 
@@ -0,0 +1,218 @@
+#include "include/opengl_headless.h"
+#include "include/opengl_core.h"
+#include "include/transformation.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#ifdef HW3_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace opengl_headless {
+
+bool write_ppm(const std::string& filename, const GLubyte* rgba, int width, int height) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row(3 * static_cast<std::size_t>(width));
+    for (int y = height - 1; y >= 0; y--) {
+        const GLubyte* pixel = rgba + 4 * static_cast<std::size_t>(y) * width;
+        for (int x = 0; x < width; x++) {
+            row[3 * x] = static_cast<char>(pixel[4 * x]);
+            row[3 * x + 1] = static_cast<char>(pixel[4 * x + 1]);
+            row[3 * x + 2] = static_cast<char>(pixel[4 * x + 2]);
+        }
+        file.write(row.data(), row.size());
+    }
+    return static_cast<bool>(file);
+}
+
+std::string frame_filename(const std::string& prefix, int frame) {
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%04d.ppm", frame);
+    return prefix + number;
+}
+
+#ifdef HW3_EGL
+
+namespace {
+
+// A core profile context that is current until the end of the scope, without any surface
+class EGLContextScope {
+public:
+    EGLContextScope() {
+        // Mesa's surfaceless platform needs neither X nor a GPU device, other drivers use their default display
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display)
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+                display = EGL_NO_DISPLAY;
+                return;
+            }
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        const EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config = nullptr;
+        EGLint config_count = 0;
+        eglChooseConfig(display, config_attributes, &config, 1, &config_count);
+        const EGLint context_attributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                             EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        context = eglCreateContext(display, config_count ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+        if (context != EGL_NO_CONTEXT && !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+    }
+
+    ~EGLContextScope() {
+        if (context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (display != EGL_NO_DISPLAY)
+            eglTerminate(display);
+    }
+
+    EGLContextScope(const EGLContextScope&) = delete;
+    EGLContextScope& operator=(const EGLContextScope&) = delete;
+
+    bool current() const {
+        return context != EGL_NO_CONTEXT;
+    }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+// Color and depth renderbuffers bound as the draw and read framebuffer
+struct Framebuffer {
+    Framebuffer(int width, int height) {
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    }
+
+    ~Framebuffer() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteFramebuffers(1, &framebuffer);
+    }
+
+    bool complete() const {
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = {0, 0};
+};
+
+} // namespace
+
+bool render_frames(const scene::SceneFile& scene, int width, int height, const std::string& prefix, int frames) {
+    EGLContextScope context;
+    if (!context.current()) {
+        std::cerr << "Error: Could not create an EGL OpenGL 3.3 core context" << std::endl;
+        return false;
+    }
+
+    // GLEW 2.2 and later load the entry points before they look for a GLX display, which an EGL context does not
+    // have, and report its absence. Older versions do not have that error.
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (status == GLEW_ERROR_NO_GLX_DISPLAY)
+        status = GLEW_OK;
+#endif
+    if (status != GLEW_OK) {
+        std::cerr << "Error: Could not initialize GLEW: " << glewGetErrorString(status) << std::endl;
+        return false;
+    }
+
+    Framebuffer framebuffer(width, height);
+    if (!framebuffer.complete()) {
+        std::cerr << "Error: Could not create a " << width << "x" << height << " framebuffer" << std::endl;
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+
+    opengl_core::CoreRenderer renderer;
+    if (!renderer.init(scene)) {
+        std::cerr << "Error: Could not build the core profile renderer" << std::endl;
+        return false;
+    }
+
+    // Two pixel buffers: glReadPixels into one returns at once, the other holds the previous frame being written
+    const std::size_t frame_bytes = 4 * static_cast<std::size_t>(width) * height;
+    GLuint pixel_buffers[2];
+    glGenBuffers(2, pixel_buffers);
+    for (GLuint buffer : pixel_buffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, nullptr, GL_STREAM_READ);
+    }
+
+    bool ok = true;
+    auto write_frame = [&](int frame) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[frame % 2]);
+        const GLubyte* pixels = static_cast<const GLubyte*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+        std::string filename = frame_filename(prefix, frame);
+        if (!pixels || !write_ppm(filename, pixels, width, height)) {
+            std::cerr << "Error: Could not write " << filename << std::endl;
+            ok = false;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    };
+
+    const Eigen::Matrix4d eye_from_world = scene.camera.get_transformation().inverse();
+    const Eigen::Matrix4d projection = scene.camera.get_perspective_projection_matrix();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        Eigen::Matrix4d view = eye_from_world * ::transformation::matrix_from_rotation_vector(0, 1, 0, 2.0 * M_PI * frame / frames);
+        scene::Frustum frustum(projection * view);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderer.draw(scene, scene.instance_bvh.visible(frustum, view.inverse().block<3,1>(0,3)), view);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[frame % 2]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        if (frame > 0)
+            write_frame(frame - 1);
+    }
+    if (frames > 0)
+        write_frame(frames - 1);
+    glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(2, pixel_buffers);
+    std::cerr << frames << " frames of " << width << "x" << height << " in " << seconds * 1e3 << " ms, "
+              << seconds * 1e3 / std::max(frames, 1) << " ms per frame (" << glGetString(GL_RENDERER) << ")" << std::endl;
+    return ok;
+}
+
+#else
+
+bool render_frames(const scene::SceneFile&, int, int, const std::string&, int) {
+    std::cerr << "Error: Built without EGL, headless rendering is not available" << std::endl;
+    return false;
+}
+
+#endif // HW3_EGL
+
+} // namespace opengl_headless
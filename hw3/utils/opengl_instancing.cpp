@@ -0,0 +1,201 @@
+#include "include/opengl_instancing.h"
+#include "include/opengl_utils.h"
+#include "include/render_stats.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace opengl_instancing {
+
+namespace {
+
+// Per instance attributes start after the locations NVIDIA aliases to gl_Vertex (0) and gl_Normal (2)
+constexpr GLuint MODEL_LOCATION = 3;        // mat4, 4 locations
+constexpr GLuint AMBIENT_LOCATION = 7;
+constexpr GLuint DIFFUSE_LOCATION = 8;
+constexpr GLuint SPECULAR_LOCATION = 9;
+constexpr GLuint EMISSION_LOCATION = 10;
+constexpr GLuint SHININESS_LOCATION = 11;
+constexpr GLuint LAST_LOCATION = 11;
+
+// Fixed function lighting with the default light model: global ambient, no local viewer, one sided,
+// GL_NORMALIZE on. The normal matrix is the cofactor matrix of the modelview, the inverse transpose up to its
+// determinant, whose sign is put back before normalizing. init() prepends the version and LIGHT_COUNT.
+const char* VERTEX_SHADER = R"(
+attribute mat4 model;
+attribute vec3 ambient;
+attribute vec3 diffuse;
+attribute vec3 specular;
+attribute vec3 emission;
+attribute float shininess;
+
+void main() {
+    vec4 eye_position = gl_ModelViewMatrix * (model * gl_Vertex);
+    mat3 linear = mat3(gl_ModelViewMatrix) * mat3(model);
+    mat3 cofactor = mat3(cross(linear[1], linear[2]), cross(linear[2], linear[0]), cross(linear[0], linear[1]));
+    float det_sign = sign(dot(linear[0], cross(linear[1], linear[2])));
+    vec3 n = normalize(det_sign * (cofactor * gl_Normal));
+
+    vec3 color = emission + ambient * gl_LightModel.ambient.rgb;
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+        vec4 p = gl_LightSource[i].position;
+        vec3 l = p.xyz;
+        float attenuation = 1.0;
+        if (p.w != 0.0) {
+            l = p.xyz / p.w - eye_position.xyz;
+            float d = length(l);
+            attenuation = 1.0 / (gl_LightSource[i].constantAttenuation + gl_LightSource[i].linearAttenuation * d
+                                 + gl_LightSource[i].quadraticAttenuation * d * d);
+        }
+        l = normalize(l);
+        float n_dot_l = max(dot(n, l), 0.0);
+        vec3 term = ambient * gl_LightSource[i].ambient.rgb + n_dot_l * diffuse * gl_LightSource[i].diffuse.rgb;
+        if (n_dot_l > 0.0) {
+            float n_dot_h = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);
+            term += pow(n_dot_h, shininess) * specular * gl_LightSource[i].specular.rgb;
+        }
+        color += attenuation * term;
+    }
+    gl_FrontColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+    gl_Position = gl_ProjectionMatrix * eye_position;
+}
+)";
+
+const char* FRAGMENT_SHADER = R"(
+#version 120
+void main() {
+    gl_FragColor = gl_Color;
+}
+)";
+
+// One element of the instance buffer
+struct InstanceData {
+    GLfloat model[16];
+    GLfloat ambient[3];
+    GLfloat diffuse[3];
+    GLfloat specular[3];
+    GLfloat emission[3];
+    GLfloat shininess;
+};
+
+GLuint program = 0;
+GLuint instance_buffer = 0;
+
+void set_instance_attribute(GLuint location, GLint size, std::size_t offset) {
+    glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<const void*>(offset));
+    render_stats::count_state_changes();
+}
+
+} // namespace
+
+std::vector<InstanceGroup> group_by_obj_file(const std::vector<models::Model>& objects,
+                                             const std::vector<std::size_t>& indices) {
+    std::vector<InstanceGroup> groups;
+    std::unordered_map<const models::ObjModel*, std::size_t> group_of;
+    for (std::size_t index : indices) {
+        const models::ObjModel* obj_file = objects[index].obj_file.get();
+        auto [it, inserted] = group_of.emplace(obj_file, groups.size());
+        if (inserted)
+            groups.push_back(InstanceGroup{obj_file, {}});
+        groups[it->second].instances.push_back(index);
+    }
+    return groups;
+}
+
+bool init(int light_count) {
+    if (!GLEW_VERSION_3_3)
+        return false;
+
+    // The light loop has a constant trip count so the compiler can unroll it like the fixed function pipeline
+    std::string vertex_source = "#version 120\nconst int LIGHT_COUNT = " + std::to_string(std::min(light_count, 8)) + ";\n";
+    program = opengl_utils::link_program(
+        opengl_utils::compile_shader(GL_VERTEX_SHADER, vertex_source + VERTEX_SHADER),
+        opengl_utils::compile_shader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER),
+        {{MODEL_LOCATION, "model"}, {AMBIENT_LOCATION, "ambient"}, {DIFFUSE_LOCATION, "diffuse"},
+         {SPECULAR_LOCATION, "specular"}, {EMISSION_LOCATION, "emission"}, {SHININESS_LOCATION, "shininess"}});
+    if (!program)
+        return false;
+    glGenBuffers(1, &instance_buffer);
+    return true;
+}
+
+bool ready() {
+    return program != 0;
+}
+
+void draw_objects(const scene::SceneFile& scene, const std::vector<std::size_t>& indices,
+                  std::optional<std::size_t> selected) {
+    std::vector<InstanceGroup> groups = group_by_obj_file(scene.objects, indices);
+
+    // The instances of all groups in one buffer, each group draws a contiguous range of it
+    std::vector<InstanceData> instances;
+    instances.reserve(indices.size());
+    for (const InstanceGroup& group : groups) {
+        for (std::size_t index : group.instances) {
+            const models::Model& model = scene.objects[index];
+            InstanceData data;
+            Eigen::Map<Eigen::Matrix4f>(data.model) = model.transform.cast<float>();
+            Eigen::Map<Eigen::Vector3f>(data.ambient) = model.ambient;
+            Eigen::Map<Eigen::Vector3f>(data.diffuse) = model.diffuse;
+            Eigen::Map<Eigen::Vector3f>(data.specular) = model.specular;
+            Eigen::Map<Eigen::Vector3f>(data.emission) = selected == index ? Eigen::Vector3f(0.3f, 0.3f, 0.0f) : Eigen::Vector3f::Zero();
+            data.shininess = model.shininess;
+            instances.push_back(data);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STREAM_DRAW);
+
+    glUseProgram(program);
+    for (GLuint location = MODEL_LOCATION; location <= LAST_LOCATION; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    render_stats::count_state_changes(3 + 2 * (LAST_LOCATION - MODEL_LOCATION + 1));
+
+    std::size_t first = 0;
+    for (const InstanceGroup& group : groups) {
+        const models::ObjModel& obj = *group.obj_file;
+        const GLsizei count = static_cast<GLsizei>(group.instances.size());
+
+        // Attribute pointers are offsets into the bound buffer, the client arrays need it unbound
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glVertexPointer(3, GL_FLOAT, sizeof(Eigen::Vector3f), obj.vertexes.data());
+        glNormalPointer(GL_FLOAT, sizeof(Eigen::Vector3f), obj.normals.data());
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        render_stats::count_state_changes(4);
+        const std::size_t base = first * sizeof(InstanceData);
+        for (int column = 0; column < 4; column++)
+            set_instance_attribute(MODEL_LOCATION + column, 4, base + offsetof(InstanceData, model) + 4 * column * sizeof(GLfloat));
+        set_instance_attribute(AMBIENT_LOCATION, 3, base + offsetof(InstanceData, ambient));
+        set_instance_attribute(DIFFUSE_LOCATION, 3, base + offsetof(InstanceData, diffuse));
+        set_instance_attribute(SPECULAR_LOCATION, 3, base + offsetof(InstanceData, specular));
+        set_instance_attribute(EMISSION_LOCATION, 3, base + offsetof(InstanceData, emission));
+        set_instance_attribute(SHININESS_LOCATION, 1, base + offsetof(InstanceData, shininess));
+
+        // A lone object takes a plain draw, which still reads its attributes from instance 0
+        if (obj.drawElement_compatible && count == 1)
+            glDrawElements(GL_TRIANGLES, 3 * obj.faces_opengl.size(), GL_UNSIGNED_INT, obj.faces_opengl.data());
+        else if (obj.drawElement_compatible)
+            glDrawElementsInstanced(GL_TRIANGLES, 3 * obj.faces_opengl.size(), GL_UNSIGNED_INT, obj.faces_opengl.data(), count);
+        else if (count == 1)
+            glDrawArrays(GL_TRIANGLES, 0, obj.vertexes.size());
+        else
+            glDrawArraysInstanced(GL_TRIANGLES, 0, obj.vertexes.size(), count);
+        render_stats::count_draw(obj.drawElement_compatible ? obj.faces_opengl.size() : obj.vertexes.size() / 3, count);
+        first += group.instances.size();
+    }
+
+    for (GLuint location = MODEL_LOCATION; location <= LAST_LOCATION; location++) {
+        glVertexAttribDivisor(location, 0);
+        glDisableVertexAttribArray(location);
+    }
+    glUseProgram(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+} // namespace opengl_instancing
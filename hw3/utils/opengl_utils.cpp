@@ -1,24 +1,46 @@
 #include "include/opengl_utils.h"
+#include "include/opengl_instancing.h"
+#include "include/opengl_core.h"
+#include "include/render_stats.h"
+#include "include/render_queue.h"
+#include "include/camera_controller.h"
 
 #include <GL/glew.h>
-#include <GL/glut.h>
+#include <GL/freeglut.h>
 #include <iostream>
 #include <string>
 #include <cmath>
 
 namespace opengl_utils {
 
-void init_window(int argc, char* argv[], int xres, int yres, std::string window_name) {
+// Whether init_window() created a core profile context
+static bool core_context = false;
+
+void init_window(int argc, char* argv[], int xres, int yres, std::string window_name, bool core_profile) {
     glutInit(&argc, argv);
+    if (core_profile) {
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+    }
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(xres, yres);
     glutInitWindowPosition(0, 0);
     glutCreateWindow(window_name.c_str());
+    core_context = core_profile;
+
+    // Core contexts do not list their extensions the old way, experimental makes GLEW load the entry points anyway
+    glewExperimental = GL_TRUE;
+    GLenum status = glewInit();
+    if (status != GLEW_OK)
+        std::cerr << "Error: Could not initialize GLEW: " << glewGetErrorString(status) << std::endl;
     
-    glShadeModel(GL_SMOOTH);
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glEnable(GL_DEPTH_TEST);
+    if (core_profile)
+        return;
+
+    glShadeModel(GL_SMOOTH);
     glEnable(GL_NORMALIZE);
     
     glEnableClientState(GL_VERTEX_ARRAY);
@@ -47,22 +69,43 @@ void init_camera(scene::SceneFile& scene) {
     const auto& camera = scene.camera;
     glFrustum(camera.l, camera.r, camera.b, camera.t, camera.n, camera.f);
 
-    // Set the camera transformation
+    // The camera transformation is loaded by display() from the camera controller every frame
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
-    glRotatef(-camera.orientation(3) * 180.0 / M_PI, camera.orientation(0), camera.orientation(1), camera.orientation(2));
-    glTranslatef(-camera.position.x(), -camera.position.y(), -camera.position.z());
 }
 
-void start_scene_rendering(scene::SceneFile& scene) {
-    init_camera(scene);
-    init_lights(scene);
+void start_scene_rendering(scene::SceneFile& scene, const std::string& stats_csv) {
+    static opengl_core::CoreRenderer core_renderer;
+    static render_stats::FrameProfiler profiler;
+    static render_queue::RenderQueue draw_queue;
+    if (!profiler.init(stats_csv))
+        return;
+    opengl_handlers::profiler = &profiler;
+    opengl_handlers::camera.init(scene.camera, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+
+    if (core_context) {
+        if (!core_renderer.init(scene)) {
+            std::cerr << "Error: Could not build the core profile renderer" << std::endl;
+            return;
+        }
+        opengl_handlers::core_renderer = &core_renderer;
+    } else {
+        init_camera(scene);
+        init_lights(scene);
+        draw_queue.init(scene);
+        opengl_handlers::draw_queue = &draw_queue;
+        opengl_handlers::instancing = opengl_instancing::init(static_cast<int>(scene.lights.size()));
+        if (!opengl_handlers::instancing)
+            std::cerr << "Instanced drawing is not supported, drawing one object at a time" << std::endl;
+    }
 
     // Set the GLUT callback functions
     glutDisplayFunc(opengl_handlers::display);
     glutReshapeFunc(opengl_handlers::window_resize);
+    glutCloseFunc(opengl_handlers::window_closed);
     glutMouseFunc(opengl_handlers::mouse_pressed);
     glutMotionFunc(opengl_handlers::mouse_motion);
+    glutKeyboardFunc(opengl_handlers::key_pressed);
     glutMainLoop();
 }
 
@@ -86,4 +129,48 @@ void print_model_matrices() {
     std::cout << "================================\n\n" << std::endl;
 }
 
+GLuint compile_shader(GLenum type, const std::string& source) {
+    GLuint shader = glCreateShader(type);
+    const char* text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Error: Could not compile shader: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint link_program(GLuint vertex, GLuint fragment, const std::vector<std::pair<GLuint, const char*>>& attribute_locations) {
+    if (!vertex || !fragment) {
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    for (const auto& [location, name] : attribute_locations)
+        glBindAttribLocation(program, location, name);
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Error: Could not link shader program: " << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
 } // namespace opengl_utils
@@ -0,0 +1,108 @@
+#include "include/render_queue.h"
+#include "include/render_stats.h"
+
+#include <algorithm>
+#include <tuple>
+#include <unordered_map>
+
+namespace render_queue {
+
+bool RenderQueue::Material::operator==(const Material& other) const {
+    return std::equal(ambient, ambient + 4, other.ambient) && std::equal(diffuse, diffuse + 4, other.diffuse) &&
+           std::equal(specular, specular + 4, other.specular) && shininess == other.shininess;
+}
+
+void RenderQueue::init(const scene::SceneFile& scene) {
+    materials.clear();
+    object_materials.clear();
+    object_materials.reserve(scene.objects.size());
+    object_meshes.clear();
+    object_meshes.reserve(scene.objects.size());
+    // Numbers instead of pointers as sort key, so the draw order does not depend on where the obj files were allocated
+    std::unordered_map<const models::ObjModel*, std::size_t> mesh_of;
+    for (const models::Model& model : scene.objects) {
+        object_meshes.push_back(mesh_of.emplace(model.obj_file.get(), mesh_of.size()).first->second);
+
+        Material material;
+        Eigen::Map<Eigen::Vector4f>(material.ambient) << model.ambient, 1.0f;
+        Eigen::Map<Eigen::Vector4f>(material.diffuse) << model.diffuse, 1.0f;
+        Eigen::Map<Eigen::Vector4f>(material.specular) << model.specular, 1.0f;
+        material.shininess = model.shininess;
+
+        // Scenes have few distinct materials, a linear search is enough
+        auto it = std::find(materials.begin(), materials.end(), material);
+        object_materials.push_back(it - materials.begin());
+        if (it == materials.end())
+            materials.push_back(material);
+    }
+}
+
+void RenderQueue::set_material(const Material& material) {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, material.shininess);
+    render_stats::count_state_changes(4);
+}
+
+void RenderQueue::draw(const scene::SceneFile& scene, const std::vector<std::size_t>& indices, const Eigen::Matrix4d& view,
+                       std::optional<std::size_t> selected) {
+    items.clear();
+    for (std::size_t index : indices) {
+        const models::Model& model = scene.objects[index];
+        if (model.obj_file)
+            items.push_back({object_meshes[index], object_materials[index], model.obj_file.get(), index});
+    }
+    std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+        return std::tie(a.mesh, a.material) < std::tie(b.mesh, b.material);
+    });
+
+    const GLfloat highlight[] = {0.3f, 0.3f, 0.0f, 1.0f};
+    const GLfloat no_emission[] = {0.0f, 0.0f, 0.0f, 1.0f};
+    glMaterialfv(GL_FRONT, GL_EMISSION, no_emission);
+    glMatrixMode(GL_MODELVIEW);
+    render_stats::count_state_changes();
+
+    const models::ObjModel* current_obj = nullptr;
+    std::size_t current_material = materials.size();
+    for (const DrawItem& item : items) {
+        const models::ObjModel& obj = *item.obj_file;
+        if (item.obj_file != current_obj) {
+            glVertexPointer(3, GL_FLOAT, sizeof(Eigen::Vector3f), obj.vertexes.data());
+            glNormalPointer(GL_FLOAT, sizeof(Eigen::Vector3f), obj.normals.data());
+            render_stats::count_state_changes(2);
+            current_obj = item.obj_file;
+        }
+        if (item.material != current_material) {
+            set_material(materials[item.material]);
+            current_material = item.material;
+        }
+        const bool highlighted = selected == item.index;
+        if (highlighted) {
+            glMaterialfv(GL_FRONT, GL_EMISSION, highlight);
+            render_stats::count_state_changes();
+        }
+
+        // One matrix load instead of a push, multiply and pop, the product is cheap next to the GL calls
+        Eigen::Matrix4d modelview = view * scene.objects[item.index].transform;
+        glLoadMatrixd(modelview.data());
+        render_stats::count_state_changes();
+
+        // If the vertexes and normal indices are the same for each face, DrawElements could be used
+        if (obj.drawElement_compatible) {
+            glDrawElements(GL_TRIANGLES, 3 * obj.faces_opengl.size(), GL_UNSIGNED_INT, obj.faces_opengl.data());
+            render_stats::count_draw(obj.faces_opengl.size());
+        } else {
+            glDrawArrays(GL_TRIANGLES, 0, obj.vertexes.size());
+            render_stats::count_draw(obj.vertexes.size() / 3);
+        }
+
+        if (highlighted) {
+            glMaterialfv(GL_FRONT, GL_EMISSION, no_emission);
+            render_stats::count_state_changes();
+        }
+    }
+    glLoadMatrixd(view.data());
+}
+
+} // namespace render_queue
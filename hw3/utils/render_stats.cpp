@@ -0,0 +1,114 @@
+#include "include/render_stats.h"
+
+#include <cstdio>
+#include <initializer_list>
+#include <iostream>
+
+namespace render_stats {
+
+Counters counters;
+
+FrameProfiler::~FrameProfiler() {
+    finish();
+    if (timer_queries)
+        glDeleteQueries(2, queries.data());
+}
+
+bool FrameProfiler::init(const std::string& csv_filename) {
+    timer_queries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (timer_queries)
+        glGenQueries(2, queries.data());
+    else
+        std::cerr << "Timer queries are not supported, only CPU times are measured" << std::endl;
+
+    if (csv_filename.empty())
+        return true;
+    csv.open(csv_filename);
+    if (!csv.is_open()) {
+        std::cerr << "Error: Could not open " << csv_filename << std::endl;
+        return false;
+    }
+    csv << "frame,cpu_ms,gpu_ms,draw_calls,state_changes,triangles\n";
+    return true;
+}
+
+void FrameProfiler::begin_frame() {
+    const std::size_t slot = frame_count % 2;
+    // The frame from two frames ago still owns this query, it goes without a GPU time rather than stalling
+    collect(slot, false);
+
+    counters = Counters();
+    start = std::chrono::steady_clock::now();
+    if (timer_queries)
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+}
+
+void FrameProfiler::end_frame() {
+    const std::size_t slot = frame_count % 2;
+    FrameRecord& frame = frames[slot];
+    frame.frame = frame_count++;
+    frame.counters = counters;
+    frame.cpu_ms = 1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    frame.gpu_ms = -1;
+    if (!timer_queries) {
+        record(frame);
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[slot] = true;
+    collect(1 - slot, true);
+}
+
+void FrameProfiler::finish() {
+    // The older frame first, so the CSV stays in frame order. GL_QUERY_RESULT waits until the result is there.
+    for (std::size_t slot : {frame_count % 2, (frame_count + 1) % 2}) {
+        if (!pending[slot])
+            continue;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+        frames[slot].gpu_ms = 1e-6 * nanoseconds;
+        pending[slot] = false;
+        record(frames[slot]);
+    }
+    if (csv.is_open())
+        csv.flush();
+}
+
+void FrameProfiler::collect(std::size_t slot, bool only_if_available) {
+    if (!pending[slot])
+        return;
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available && only_if_available)
+        return;
+    if (available) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+        frames[slot].gpu_ms = 1e-6 * nanoseconds;
+    }
+    pending[slot] = false;
+    record(frames[slot]);
+}
+
+void FrameProfiler::record(const FrameRecord& frame) {
+    last_complete = frame;
+    if (!csv.is_open())
+        return;
+    csv << frame.frame << "," << frame.cpu_ms << ",";
+    if (frame.gpu_ms >= 0)
+        csv << frame.gpu_ms;
+    csv << "," << frame.counters.draw_calls << "," << frame.counters.state_changes << "," << frame.counters.triangles << "\n";
+}
+
+std::string FrameProfiler::summary() const {
+    const FrameRecord& frame = last_complete;
+    char gpu[32] = "gpu n/a";
+    if (frame.gpu_ms >= 0)
+        std::snprintf(gpu, sizeof(gpu), "gpu %.2f ms", frame.gpu_ms);
+    char text[160];
+    std::snprintf(text, sizeof(text), "%s, cpu %.2f ms, %zu draws, %zu state changes, %.2fM triangles", gpu,
+                  frame.cpu_ms, frame.counters.draw_calls, frame.counters.state_changes, 1e-6 * frame.counters.triangles);
+    return text;
+}
+
+} // namespace render_stats